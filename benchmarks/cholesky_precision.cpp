@@ -0,0 +1,104 @@
+/*
+    Benchmark of the factorization of the GP covariance matrix: Eigen's LLT
+    in double precision (as in RVmodel before cholesky::Factor) against
+    cholesky::Factor in full and mixed precision, for the quasi-periodic
+    kernel at random times. Prints the time per factorization + likelihood
+    and the error in the log-likelihood relative to LLT.
+
+    usage: cholesky_precision [N ...] [-t threads]
+*/
+#include "cholesky.h"
+#include <Eigen/Dense>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <random>
+#include <chrono>
+
+using namespace std;
+using namespace Eigen;
+
+// the covariance matrix of RVmodel::calculate_C
+MatrixXd covariance(const vector<double>& t, double eta1, double eta2,
+                    double eta3, double eta4, double sig2)
+{
+    size_t N = t.size();
+    MatrixXd C(N, N);
+    for(size_t i=0; i<N; i++)
+        for(size_t j=0; j<N; j++)
+            C(i, j) = eta1*eta1*exp(-0.5*pow((t[i] - t[j])/eta2, 2)
+                        -2.0*pow(sin(M_PI*(t[i] - t[j])/eta3)/eta4, 2))
+                      + (i == j ? sig2 : 0.);
+    return C;
+}
+
+template <typename F>
+double milliseconds(F f, int repeat)
+{
+    auto begin = chrono::high_resolution_clock::now();
+    for(int i=0; i<repeat; i++)
+        f();
+    auto end = chrono::high_resolution_clock::now();
+    return chrono::duration<double, milli>(end - begin).count() / repeat;
+}
+
+int main(int argc, char** argv)
+{
+    vector<int> sizes;
+    unsigned threads = 1;
+    for(int i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "-t") == 0 && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else
+            sizes.push_back(atoi(argv[i]));
+    }
+    if(sizes.empty())
+        sizes = {500, 1000, 2000};
+
+    mt19937 gen(42);
+    uniform_real_distribution<double> uniform(0., 2000.);
+    normal_distribution<double> normal(0., 1.);
+
+    printf("#   N   precision   used    time (ms)   speed-up   logL error\n");
+    for(int N : sizes)
+    {
+        vector<double> t(N);
+        for(auto& ti : t) ti = uniform(gen);
+        MatrixXd C = covariance(t, 3., 30., 25., 0.5, 2.);
+        VectorXd r(N);
+        for(int i=0; i<N; i++) r(i) = 3.*normal(gen);
+
+        int repeat = N < 1000 ? 10 : N < 3000 ? 3 : 1;
+
+        // reference: Eigen's LLT in double precision
+        double logL_ref = 0.;
+        double t_ref = milliseconds([&]{
+            LLT<MatrixXd> llt(C);
+            double logdet = 0.;
+            for(int i=0; i<N; i++)
+                logdet += 2.*log(llt.matrixLLT()(i,i));
+            VectorXd z = llt.matrixL().solve(r);
+            logL_ref = -0.5*logdet - 0.5*z.squaredNorm();
+        }, repeat);
+        printf("%5d   %-9s   %-5s   %9.2f   %8.2f   %.3e\n",
+               N, "LLT", "full", t_ref, 1., 0.);
+
+        for(auto precision : {cholesky::Precision::full, cholesky::Precision::mixed})
+        {
+            cholesky::Factor factor;
+            double logL = 0.;
+            double time = milliseconds([&]{
+                factor.compute(C, threads, 0, precision);
+                logL = -0.5*factor.log_determinant() - 0.5*factor.quadratic(C, r);
+            }, repeat);
+            printf("%5d   %-9s   %-5s   %9.2f   %8.2f   %.3e\n", N,
+                   precision == cholesky::Precision::full ? "full" : "mixed",
+                   factor.get_precision() == cholesky::Precision::full ? "full" : "mixed",
+                   time, t_ref/time, logL - logL_ref);
+        }
+    }
+    return 0;
+}
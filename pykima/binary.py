@@ -0,0 +1,176 @@
+"""
+Binary RV data files, which kima reads without parsing (Data::load_binary).
+
+The file starts with a header of 64 bytes (little-endian)
+    magic "KIMARVB\\0", version, offset of the columns, number of points,
+    number of instruments, lines skipped in the text files, units,
+    CRC-32 of the columns, sizes of the instrument and file names, flags
+followed by the zero-terminated instrument names and text file names, and
+the columns t, y, sig (float64) and obsi (int32), each aligned to 64 bytes.
+"""
+from __future__ import print_function
+
+import os
+import struct
+import zlib
+import argparse
+import numpy as np
+
+MAGIC = b'KIMARVB\x00'
+VERSION = 1
+HEADER = struct.Struct('<8sIIQIi8sIIII8x')
+MULTI = 1
+
+
+def _align64(n):
+    return (n + 63) // 64 * 64
+
+
+def _read_text(filename, skip, ncols):
+    """ Read the first `ncols` columns of a text file, as Data::load does """
+    with open(filename) as f:
+        lines = f.readlines()[skip:]
+    lines = [line.replace(',', ' ') for line in lines]
+    data = np.loadtxt(lines, usecols=range(ncols), ndmin=2)
+    return data
+
+
+def is_binary(filename):
+    """ Is `filename` a binary RV data file? """
+    if isinstance(filename, (list, tuple)):
+        return False
+    try:
+        with open(filename, 'rb') as f:
+            return f.read(len(MAGIC)) == MAGIC
+    except (IOError, OSError):
+        return False
+
+
+def write_binary(output, filenames, units='ms', skip=0, multi=None,
+                 names=None):
+    """
+    Convert the text file(s) `filenames` to the binary file `output`.
+    As in Data::load_multi, with a list of files each one is an instrument
+    and the points are sorted in time, and with one file and `multi`=True
+    the 4th column identifies the instrument. `units` ('ms' or 'kms') and
+    `skip` are as in Data::load. The instrument names default to the names
+    of the files.
+    """
+    if not isinstance(filenames, (list, tuple)):
+        filenames = [filenames]
+    if multi is None:
+        multi = len(filenames) > 1
+
+    if len(filenames) > 1:
+        data, obs = [], []
+        for i, filename in enumerate(filenames):
+            d = _read_text(filename, skip, 3)
+            data.append(d)
+            obs.append(np.full(d.shape[0], i + 1, dtype=int))
+        data = np.concatenate(data)
+        obs = np.concatenate(obs)
+        ind = np.argsort(data[:, 0], kind='mergesort')
+        data, obs = data[ind], obs[ind]
+        if names is None:
+            names = [os.path.splitext(os.path.basename(f))[0]
+                     for f in filenames]
+    elif multi:
+        d = _read_text(filenames[0], skip, 4)
+        data, obs = d[:, :3], d[:, 3].astype(int)
+    else:
+        data = _read_text(filenames[0], skip, 3)
+        obs = np.ones(data.shape[0], dtype=int)
+
+    N = data.shape[0]
+    ninst = np.unique(obs).size
+    if names is None:
+        names = []
+
+    names_block = b''.join(n.encode('utf-8') + b'\x00' for n in names)
+    sources_block = b''.join(
+        os.path.abspath(f).encode('utf-8') + b'\x00' for f in filenames)
+    offset = _align64(HEADER.size + len(names_block) + len(sources_block))
+
+    body = b''
+    for column, dtype in ((data[:, 0], '<f8'), (data[:, 1], '<f8'),
+                          (data[:, 2], '<f8'), (obs, '<i4')):
+        b = np.ascontiguousarray(column, dtype=dtype).tobytes()
+        body += b + b'\x00' * (_align64(len(b)) - len(b))
+    crc = zlib.crc32(body) & 0xffffffff
+
+    header = HEADER.pack(MAGIC, VERSION, offset, N, ninst, skip,
+                         units.encode('ascii'), crc, len(names_block),
+                         len(sources_block), MULTI if multi else 0)
+    padding = offset - len(header) - len(names_block) - len(sources_block)
+
+    with open(output, 'wb') as f:
+        f.write(header + names_block + sources_block + b'\x00' * padding)
+        f.write(body)
+
+
+def read_binary(filename):
+    """
+    Read the binary file `filename`. Returns the (N,3) array of times, RVs
+    and uncertainties (in the units of the file), the instrument of each
+    point, and a dictionary with the rest of the header.
+    """
+    with open(filename, 'rb') as f:
+        raw = f.read()
+
+    (magic, version, offset, N, ninst, skip, units, crc, names_size,
+     sources_size, flags) = HEADER.unpack_from(raw)
+    if magic != MAGIC:
+        raise ValueError('%s is not a kima binary file' % filename)
+    if version != VERSION:
+        raise ValueError('unknown version %d of %s' % (version, filename))
+    if zlib.crc32(raw[offset:]) & 0xffffffff != crc:
+        raise ValueError('the checksum of %s does not match' % filename)
+
+    def split(block):
+        return [s.decode('utf-8') for s in block.split(b'\x00')[:-1]]
+
+    names = split(raw[HEADER.size:HEADER.size + names_size])
+    sources = split(raw[HEADER.size + names_size:
+                        HEADER.size + names_size + sources_size])
+
+    column = _align64(8 * N)
+    data = np.empty((N, 3))
+    for i in range(3):
+        data[:, i] = np.frombuffer(raw, dtype='<f8', count=N,
+                                   offset=offset + i * column)
+    obs = np.frombuffer(raw, dtype='<i4', count=N,
+                        offset=offset + 3 * column).astype(int)
+
+    info = dict(units=units.rstrip(b'\x00').decode('ascii'), skip=skip,
+                multi=bool(flags & MULTI), instruments=ninst, names=names,
+                sources=sources)
+    return data, obs, info
+
+
+def _parse_args():
+    desc = """Convert RV data files to kima's binary format
+    (read with Data::get_instance().load_binary(filename) in kima_setup.cpp)"""
+    parser = argparse.ArgumentParser(description=desc, prog='kima-rv2bin')
+    parser.add_argument('files', nargs='+',
+                        help='text file(s); each of several files is one instrument')
+    parser.add_argument('-o', '--output', required=True,
+                        help='name of the binary file')
+    parser.add_argument('--units', default='ms', choices=('ms', 'kms'),
+                        help='units of the RVs and uncertainties')
+    parser.add_argument('--skip', type=int, default=0,
+                        help='number of lines to skip in each file')
+    parser.add_argument('--multi', action='store_true',
+                        help='one file with the instrument in the 4th column')
+    parser.add_argument('--names', nargs='+',
+                        help='names of the instruments')
+    return parser.parse_args()
+
+
+def main():
+    args = _parse_args()
+    multi = args.multi or len(args.files) > 1
+    write_binary(args.output, args.files, units=args.units, skip=args.skip,
+                 multi=multi, names=args.names)
+    data, obs, info = read_binary(args.output)
+    print('Wrote %d points from %d instrument(s) to %s' %
+          (data.shape[0], info['instruments'], args.output))
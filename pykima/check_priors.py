@@ -5,6 +5,8 @@ import scipy.stats as st
 import matplotlib.pyplot as plt
 import argparse
 
+from .loading import binary_samples, load_binary_samples
+
 
 def _parse_args():
     desc = """
@@ -39,10 +41,13 @@ def main():
     column = args.column[0]
     log = args.log
 
-    with open('sample.txt') as f:
-        firstline = f.readline()
-    firstline = firstline.strip().replace('#', '')
-    names = firstline.split()
+    if binary_samples():
+        sample, names = load_binary_samples()
+    else:
+        with open('sample.txt') as f:
+            firstline = f.readline()
+        firstline = firstline.strip().replace('#', '')
+        names = firstline.split()
 
     try:
         name = names[column - 1]
@@ -51,7 +56,10 @@ def main():
         name = 'column %d' % column
         print ('Histogram of column %d' % column)
 
-    data = np.loadtxt('sample.txt', usecols=(column - 1,))
+    if binary_samples():
+        data = np.array(sample[:, column - 1])
+    else:
+        data = np.loadtxt('sample.txt', usecols=(column - 1,))
     data = data[np.nonzero(data)[0]]
     nsamples = data.size
     print ('  number of samples: %d' % nsamples)
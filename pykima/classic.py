@@ -1,4 +1,6 @@
 import copy
+from multiprocessing import cpu_count
+from multiprocessing.pool import ThreadPool
 import numpy as np
 import matplotlib.pyplot as plt
 from .loading import *
@@ -17,15 +19,51 @@ def logdiffexp(x1, x2):
 	return result
 
 
+def sandwiching_levels(levels, sample_info):
+	"""
+	The index of the highest level below each sample in (log-likelihood,
+	tiebreaker), and not below the level the sample was saved at
+	"""
+	sandwich = sample_info[:,0].copy().astype('int')
+	logl_levels, tb_levels = levels[:,1], levels[:,2]
+	logl, tb = sample_info[:,1], sample_info[:,2]
+
+	ordered = np.all((logl_levels[1:] > logl_levels[:-1]) |
+	                 ((logl_levels[1:] == logl_levels[:-1]) &
+	                  (tb_levels[1:] >= tb_levels[:-1])))
+	if not ordered:
+		for i in range(0, sample_info.shape[0]):
+			while sandwich[i] < levels.shape[0]-1 and \
+			      (logl[i], tb[i], i) > (logl_levels[sandwich[i]+1], tb_levels[sandwich[i]+1]):
+				sandwich[i] += 1
+		return sandwich
+
+	# the number of levels below each sample, where a level with the same
+	# log-likelihood is below if its tiebreaker is not larger
+	below = np.searchsorted(logl_levels, logl, side='left')
+	above = np.searchsorted(logl_levels, logl, side='right')
+	for i in np.nonzero(above > below)[0]:
+		below[i] += np.sum(tb_levels[below[i]:above[i]] <= tb[i])
+	return np.maximum(sandwich, below - 1)
+
+
 def postprocess(temperature=1., numResampleLogX=1, plot=True, loaded=[], \
 			cut=0., save=True, zoom_in=True, compression_bias_min=1., verbose=True,\
-			compression_scatter=0., moreSamples=1., compression_assert=None, single_precision=False):
+			compression_scatter=0., moreSamples=1., compression_assert=None, single_precision=False,\
+			threads=None):
 	if len(loaded) == 0:
 		levels_orig = np.atleast_2d(my_loadtxt("levels.txt"))
 		sample_info = np.atleast_2d(my_loadtxt("sample_info.txt"))
 	else:
 		levels_orig, sample_info = loaded[0], loaded[1]
 
+	# the samples from sample.bin, of which the last ones may not have been
+	# written yet
+	binary = binary_samples()
+	if binary:
+		sample, names = load_binary_samples()
+		sample_info = sample_info[:sample.shape[0], :]
+
 	# Remove regularisation from levels_orig if we asked for it
 	if compression_assert is not None:
 		levels_orig[1:,0] = -np.cumsum(compression_assert*np.ones(levels_orig.shape[0] - 1))
@@ -54,9 +92,6 @@ def postprocess(temperature=1., numResampleLogX=1, plot=True, loaded=[], \
 		        title='DNest4: MCMC acceptance fraction for each level')
 		fig.tight_layout()
 
-	# Convert to lists of tuples
-	logl_levels = [(levels_orig[i,1], levels_orig[i, 2]) for i in range(0, levels_orig.shape[0])] # logl, tiebreaker
-	logl_samples = [(sample_info[i, 1], sample_info[i, 2], i) for i in range(0, sample_info.shape[0])] # logl, tiebreaker, id
 	logx_samples = np.zeros((sample_info.shape[0], numResampleLogX))
 	logp_samples = np.zeros((sample_info.shape[0], numResampleLogX))
 	logP_samples = np.zeros((sample_info.shape[0], numResampleLogX))
@@ -65,62 +100,69 @@ def postprocess(temperature=1., numResampleLogX=1, plot=True, loaded=[], \
 	H_estimates = np.zeros((numResampleLogX, 1))
 
 	# Find sandwiching level for each sample
-	sandwich = sample_info[:,0].copy().astype('int')
-	for i in range(0, sample_info.shape[0]):
-		while sandwich[i] < levels_orig.shape[0]-1 and logl_samples[i] > logl_levels[sandwich[i] + 1]:
-			sandwich[i] += 1
-
+	sandwich = sandwiching_levels(levels_orig, sample_info)
+
+	# The samples of each level, in order of (logl, tiebreaker, id)
+	nlevels = levels_orig.shape[0]
+	ids = np.arange(sample_info.shape[0])
+	order = np.lexsort((ids, sample_info[:,2], sample_info[:,1], sandwich))
+	bounds = np.concatenate(([0], np.cumsum(np.bincount(sandwich, minlength=nlevels))))
+
+	# The random numbers of each resampling, in the order they were drawn
+	# one resampling after the other, so that the resamplings can be done
+	# in parallel with the same results for a given seed
+	draws = []
 	for z in range(0, numResampleLogX):
+		bias = np.random.rand()
+		scatter = np.random.randn(nlevels - 1)
+		U = np.random.rand(sample_info.shape[0]) if numResampleLogX > 1 else None
+		draws.append((bias, scatter, U))
+
+	logl = sample_info[:,1]/temperature
+	perturbed_levels = [None]*numResampleLogX
+
+	def resample_logx(z):
+		bias, scatter, U_all = draws[z]
+
 		# Make a monte carlo perturbation of the level compressions
 		levels = levels_orig.copy()
 		compressions = -np.diff(levels[:,0])
-		compressions *= compression_bias_min + (1. - compression_bias_min)*np.random.rand()
-		compressions *= np.exp(compression_scatter*np.random.randn(compressions.size))
+		compressions *= compression_bias_min + (1. - compression_bias_min)*bias
+		compressions *= np.exp(compression_scatter*scatter)
 		levels[1:, 0] = -compressions
 		levels[:, 0] = np.cumsum(levels[:,0])
+		perturbed_levels[z] = levels
 
 		# For each level
-		for i in range(0, levels.shape[0]):
-			# Find the samples sandwiched by this level
-			which = np.nonzero(sandwich == i)[0]
-			logl_samples_thisLevel = [] # (logl, tieBreaker, ID)
-			for j in range(0, len(which)):
-				logl_samples_thisLevel.append(copy.deepcopy(logl_samples[which[j]]))
-			logl_samples_thisLevel = sorted(logl_samples_thisLevel)
-			N = len(logl_samples_thisLevel)
+		for i in range(0, nlevels):
+			# The samples sandwiched by this level
+			which = order[bounds[i]:bounds[i+1]]
+			N = which.size
+			if N == 0:
+				continue
 
 			# Generate intermediate logx values
 			logx_max = levels[i, 0]
-			if i == levels.shape[0]-1:
+			if i == nlevels-1:
 				logx_min = -1E300
 			else:
 				logx_min = levels[i+1, 0]
 			Umin = np.exp(logx_min - logx_max)
 
-			if N == 0 or numResampleLogX > 1:
-				U = Umin + (1. - Umin)*np.random.rand(len(which))
+			if numResampleLogX > 1:
+				U = Umin + (1. - Umin)*U_all[bounds[i]:bounds[i+1]]
 			else:
 				U = Umin + (1. - Umin)*np.linspace(1./(N+1), 1. - 1./(N+1), N)
 			logx_samples_thisLevel = np.sort(logx_max + np.log(U))[::-1]
+			logx_samples[which, z] = logx_samples_thisLevel
 
-			for j in range(0, which.size):
-				logx_samples[logl_samples_thisLevel[j][2]][z] = logx_samples_thisLevel[j]
-
-				if j != which.size - 1:
-					left = logx_samples_thisLevel[j+1]
-				elif i == levels.shape[0]-1:
-					left = -1E300
-				else:
-					left = levels[i+1][0]
-
-				if j != 0:
-					right = logx_samples_thisLevel[j-1]
-				else:
-					right = levels[i][0]
-
-				logp_samples[logl_samples_thisLevel[j][2]][z] = np.log(0.5) + logdiffexp(right, left)
-
-		logl = sample_info[:,1]/temperature
+			left = np.empty(N)
+			left[:-1] = logx_samples_thisLevel[1:]
+			left[-1] = -1E300 if i == nlevels-1 else levels[i+1][0]
+			right = np.empty(N)
+			right[1:] = logx_samples_thisLevel[:-1]
+			right[0] = levels[i][0]
+			logp_samples[which, z] = np.log(0.5) + logdiffexp(right, left)
 
 		logp_samples[:,z] = logp_samples[:,z] - logsumexp(logp_samples[:,z])
 		logP_samples[:,z] = logp_samples[:,z] + logl
@@ -129,6 +171,19 @@ def postprocess(temperature=1., numResampleLogX=1, plot=True, loaded=[], \
 		P_samples[:,z] = np.exp(logP_samples[:,z])
 		H_estimates[z] = -logz_estimates[z] + np.sum(P_samples[:,z]*logl)
 
+	if threads is None:
+		threads = cpu_count()
+	threads = max(1, min(threads, numResampleLogX))
+	if threads > 1:
+		pool = ThreadPool(threads)
+		pool.map(resample_logx, range(0, numResampleLogX))
+		pool.close()
+	else:
+		for z in range(0, numResampleLogX):
+			resample_logx(z)
+
+	for z in range(0, numResampleLogX):
+		levels = perturbed_levels[z]
 		if plot:
 			fig, (ax1, ax2) = plt.subplots(2,1)
 			ax1.plot(logx_samples[:,z], sample_info[:,1], 'k.', label='Samples')
@@ -189,13 +244,16 @@ def postprocess(temperature=1., numResampleLogX=1, plot=True, loaded=[], \
 		rows[i] = which + cut
 
     # Get header rows
-	f1 = open("sample.txt", "r")
-	line = f1.readline()
-	if line[0] == "#":
-		header = line[1:]
+	if binary:
+		header = "   ".join(names)
 	else:
-		header = ""
-	f1.close()
+		f1 = open("sample.txt", "r")
+		line = f1.readline()
+		if line[0] == "#":
+			header = line[1:]
+		else:
+			header = ""
+		f1.close()
 	f2 = open("sample_info.txt", "r")
 	line = f2.readline()
 	if line[0] == "#":
@@ -204,15 +262,19 @@ def postprocess(temperature=1., numResampleLogX=1, plot=True, loaded=[], \
 		header_info = ""
 	f2.close()
 
-	sample = loadtxt_rows("sample.txt", set(rows), single_precision)
+	if binary:
+		ncol = sample.shape[1]
+	else:
+		sample = loadtxt_rows("sample.txt", set(rows), single_precision)
+		ncol = sample["ncol"]
 	sample_info = loadtxt_rows("sample_info.txt", set(rows), single_precision)
 	posterior_sample = None
 	posterior_sample_lnlike = None
 	if single_precision:
-		posterior_sample = np.empty((N, sample["ncol"]), dtype="float32")
+		posterior_sample = np.empty((N, ncol), dtype="float32")
 		posterior_sample_lnlike = np.empty((N, sample_info["ncol"]), dtype="float32")
 	else:
-		posterior_sample = np.empty((N, sample["ncol"]))
+		posterior_sample = np.empty((N, ncol))
 		posterior_sample_lnlike = np.empty((N, sample_info["ncol"]))
 
 	for i in range(0, N):
@@ -248,6 +310,13 @@ compression_scatter=0., moreSamples=1., compression_assert=None, single_precisio
 	else:
 		levels_orig, sample_info = loaded[0], loaded[1]
 
+	# the samples from sample.bin, of which the last ones may not have been
+	# written yet
+	binary = binary_samples()
+	if binary:
+		sample, names = load_binary_samples()
+		sample_info = sample_info[:sample.shape[0], :]
+
 	# Remove regularisation from levels_orig if we asked for it
 	if compression_assert is not None:
 		levels_orig[1:,0] = -np.cumsum(compression_assert*np.ones(levels_orig.shape[0] - 1))
@@ -421,12 +490,16 @@ compression_scatter=0., moreSamples=1., compression_assert=None, single_precisio
 				break
 		rows[i] = which + cut
 
-	sample = loadtxt_rows("sample.txt", set(rows), single_precision)
+	if binary:
+		ncol = sample.shape[1]
+	else:
+		sample = loadtxt_rows("sample.txt", set(rows), single_precision)
+		ncol = sample["ncol"]
 	posterior_sample = None
 	if single_precision:
-		posterior_sample = np.empty((N, sample["ncol"]), dtype="float32")
+		posterior_sample = np.empty((N, ncol), dtype="float32")
 	else:
-		posterior_sample = np.empty((N, sample["ncol"]))
+		posterior_sample = np.empty((N, ncol))
 
 	for i in range(0, N):
 		posterior_sample[i, :] = sample[rows[i]]
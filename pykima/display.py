@@ -10,11 +10,13 @@ except ImportError:
     # Python 2
     import ConfigParser as configparser
 
-from .keplerian import keplerian
+from .keplerian import keplerian, keplerian_batch
 from .GP import GP, QPkernel
+from .binary import is_binary, read_binary
+from .loading import my_loadtxt, binary_samples, load_binary_samples
 from .utils import need_model_setup, get_planet_mass, get_planet_semimajor_axis,\
                    percentile68_ranges, percentile68_ranges_latex,\
-                   read_datafile, lighten_color
+                   read_datafile, read_appended, lighten_color
 
 
 import matplotlib.pyplot as plt
@@ -68,6 +70,7 @@ class KimaResults(object):
         self.setup = setup
 
 
+        from_setup = data_file is None
         if data_file is None:
             self.multi = setup['kima']['multi'] == 'true'
             if self.multi:
@@ -101,6 +104,9 @@ class KimaResults(object):
             self.obs = self.obs[ind]
             self.n_instruments = np.unique(self.obs).size
             self.n_jitters = self.n_instruments
+        elif is_binary(self.data_file):
+            self.data = read_binary(self.data_file)[0]
+            self.n_jitters = 1
         else:
             self.data = np.loadtxt(self.data_file,
                                    skiprows=self.data_skip, usecols=(0,1,2))
@@ -111,6 +117,18 @@ class KimaResults(object):
             self.data[:, 1] *= 1e3
             self.data[:, 2] *= 1e3
 
+        # the points added with Data::append, kept in time order as in kima
+        if from_setup:
+            appended, appended_obs = read_appended(setup['kima'])
+            if appended.shape[0] > 0:
+                self.data = np.append(self.data, appended, axis=0)
+                ind = self.data[:,0].argsort(kind='mergesort')
+                self.data = self.data[ind]
+                if self.multi:
+                    self.obs = np.append(self.obs, appended_obs)[ind]
+                    self.n_instruments = np.unique(self.obs).size
+                    self.n_jitters = self.n_instruments
+
         self.tmiddle = self.data[:,0].min() + 0.5*self.data[:,0].ptp()
 
         self.posterior_sample = np.atleast_2d(np.loadtxt(posterior_samples_file))
@@ -125,7 +143,10 @@ class KimaResults(object):
                   'log-likelihoods will not be available.')
 
         try:
-            self.sample = np.loadtxt('sample.txt')
+            if binary_samples():
+                self.sample = load_binary_samples()[0]
+            else:
+                self.sample = my_loadtxt('sample.txt')
         except IOError:
             self.sample = None
 
@@ -832,31 +853,22 @@ class KimaResults(object):
         fig, ax = plt.subplots(1,1)
         ax.set_title('Posterior samples in RV data space')
 
+        ## the Keplerian curves of all the random samples at once
+        # (P, K, phi, ecc, w) of each planet in each sample
+        pars = samples[ii].reshape(ncurves, self.n_dimensions,
+                                   self.max_components)
+        pars = pars[:, :5, :].transpose(0, 2, 1)
+        v_tt = keplerian_batch(tt, pars, t[0])
+        if self.GPmodel:
+            v_t = keplerian_batch(t, pars, t[0])
+            v_ttGP = keplerian_batch(ttGP, pars, t[0])
+
         ## plot the Keplerian curves
-        for i in ii:
-            v = np.zeros_like(tt)
+        for k, i in enumerate(ii):
+            v = v_tt[k]
             if self.GPmodel:
-                v_at_t = np.zeros_like(t)
-                v_at_ttGP = np.zeros_like(ttGP)
-
-            # get the planet parameters for the current (ith) sample
-            pars = samples[i, :].copy()
-            # how many planets in this sample?
-            nplanets = pars.size / self.n_dimensions
-            # add the Keplerians for each of the planets
-            for j in range(int(nplanets)):
-                P = pars[j + 0*self.max_components]
-                if P==0.0:
-                    continue
-                K = pars[j + 1*self.max_components]
-                phi = pars[j + 2*self.max_components]
-                t0 = t[0] - (P*phi)/(2.*np.pi)
-                ecc = pars[j + 3*self.max_components]
-                w = pars[j + 4*self.max_components]
-                v += keplerian(tt, P, K, ecc, w, t0, 0.)
-                if self.GPmodel:
-                    v_at_t += keplerian(t, P, K, ecc, w, t0, 0.)
-                    v_at_ttGP += keplerian(ttGP, P, K, ecc, w, t0, 0.)
+                v_at_t = v_t[k]
+                v_at_ttGP = v_ttGP[k]
 
             # systemic velocity for the current (ith) sample
             vsys = self.posterior_sample[mask][i, -1]
@@ -1,8 +1,21 @@
-__all__ = ['keplerian', 'true_anomaly', 'ecc_anomaly']
+__all__ = ['keplerian', 'keplerian_batch', 'true_anomaly', 'ecc_anomaly']
 
+import os
+import ctypes
 import numpy as np 
 pi = np.pi
 
+# kima's Kepler solver, built with `make libkepler`
+try:
+    _lib = ctypes.CDLL(os.path.join(os.path.dirname(__file__), 'libkepler.so'))
+    _array = np.ctypeslib.ndpointer(dtype=np.float64, flags='C_CONTIGUOUS')
+    _lib.kepler_keplerian_batch.restype = None
+    _lib.kepler_keplerian_batch.argtypes = [
+        _array, ctypes.c_size_t, ctypes.c_double, _array, ctypes.c_size_t,
+        ctypes.c_size_t, _array, ctypes.c_double, ctypes.c_int]
+except OSError:
+    _lib = None
+
 def keplerian(time, p, k, ecc, omega, t0, vsys):
     vel = np.zeros_like(time)
     p, k, ecc, omega, t0 = np.atleast_1d(p, k, ecc, omega, t0)
@@ -16,6 +29,37 @@ def keplerian(time, p, k, ecc, omega, t0, vsys):
         vel += vsys
     return vel
 
+def keplerian_batch(time, params, t_first, tolerance=0., threads=None):
+    """
+    The sum of the Keplerian curves of each of many samples, at the times
+    `time`. `params` has shape (samples, planets, 5), with (P, K, phi, ecc, w)
+    for each planet, where phi is the mean anomaly at `t_first` (the first 
+    time of the data, as in kima), and P=0 for planets that are not in a 
+    sample. Returns an array of shape (samples, time.size).
+
+    Uses the Kepler solver of kima with `threads` threads (default: all 
+    cores) if pykima/libkepler.so was built, otherwise `keplerian`. With 
+    `tolerance` > 0 (in m/s, kepler_tolerance*min(uncertainty) in kima), 
+    low-eccentricity orbits are approximated as in kima.
+    """
+    time = np.ascontiguousarray(time, dtype=np.float64)
+    params = np.ascontiguousarray(params, dtype=np.float64)
+    S, planets = params.shape[:2]
+    rv = np.zeros((S, time.size))
+
+    if _lib is not None:
+        _lib.kepler_keplerian_batch(time, time.size, t_first, params, S,
+                                    planets, rv, tolerance, threads or 0)
+        return rv
+
+    for s in range(S):
+        for P, K, phi, ecc, w in params[s]:
+            if P == 0.0:
+                continue
+            t0 = t_first - (P*phi)/(2.*pi)
+            rv[s] += keplerian(time, P, K, ecc, w, t0, 0.)
+    return rv
+
 def true_anomaly(E, e):
     return 2. * np.arctan( np.sqrt((1.+e)/(1.-e)) * np.tan(E/2.))
 
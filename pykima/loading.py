@@ -1,93 +1,199 @@
 # -*- coding: utf-8 -*-
 
+import os
+import struct
+import warnings
 import numpy as np
 
-__all__ = ["my_loadtxt", "loadtxt_rows", "load_column_names"]
+__all__ = ["TextLoader", "my_loadtxt", "loadtxt_rows", "load_column_names",
+           "binary_samples", "load_binary_samples"]
 
-def my_loadtxt(filename, single_precision=False, delimiter=" "):
+class TextLoader(object):
     """
-    Load quickly
+    Load a text file of numbers (like sample.txt, sample_info.txt or
+    levels.txt) in large chunks, optionally only some of its columns and
+    rows. Lines starting with "#" are skipped, and the file ends at the
+    first line with a different number of columns than the first row.
+    Calling `update` again loads only the rows added to the file since.
     """
-    # Open the file
-    f = open(filename, "r")
-
-    # Storage
-    results = []
-
-    # Rows and columns
-    nrow = 0
-    ncol = None
-
-    while(True):
-        # Read the line and split by whitespace
-        line = f.readline()
-        if delimiter != " ":
-            cells = line.split(delimiter)
-        else:
-            cells = line.split()
-
-        # Quit when you see a different number of columns
-        if ncol is not None and len(cells) != ncol:
-            break
-
-        # Non-comment lines
-        if cells[0][0] != "#":
-            # If it's the first one, get the number of columns
-            if ncol is None:
-                ncol = len(cells)
-
-            # Otherwise, include in results
-            if single_precision:
-                results.append(np.array([float(cell) for cell in cells],\
-                                                          dtype="float32"))
+    def __init__(self, filename, usecols=None, rows=None,
+                 single_precision=False, delimiter=" ", chunk_size=2**22):
+        self.filename = filename
+        self.usecols = usecols
+        self.rows = None if rows is None else np.unique(list(rows))
+        self.dtype = "float32" if single_precision else "float64"
+        self.delimiter = None if delimiter == " " else delimiter.encode()
+        self.chunk_size = chunk_size
+
+        self.ncol = None       # number of columns in the file
+        self.nrow = 0          # number of rows read, selected or not
+        self.row_index = []    # the indices of the rows that were kept
+        self.offset = 0        # where to continue reading
+        self.finished = False  # was the end of the table found?
+        self._blocks = []
+
+    @property
+    def data(self):
+        """ The rows loaded so far """
+        if len(self._blocks) != 1:
+            if self._blocks:
+                self._blocks = [np.concatenate(self._blocks)]
             else:
-                results.append(np.array([float(cell) for cell in cells]))
+                ncol = self.ncol or 0
+                if self.usecols is not None:
+                    ncol = len(np.arange(ncol)[self.usecols])
+                return np.empty((0, ncol), dtype=self.dtype)
+        return self._blocks[0]
+
+    def update(self, last_line=True):
+        """
+        Load the rows not loaded yet, and return all of them. With
+        `last_line`=False, a last line without a newline is left for the
+        next update (the file may still be being written).
+        """
+        if self.finished:
+            return self.data
+
+        with open(self.filename, "rb") as f:
+            f.seek(self.offset)
+            buffer = b""
+            while not self.finished:
+                chunk = f.read(self.chunk_size)
+                at_end = len(chunk) == 0
+                buffer += chunk
+
+                # only whole lines, except at the end of the file
+                end = buffer.rfind(b"\n") + 1
+                if at_end and last_line:
+                    end = len(buffer)
+                if end == 0:
+                    if at_end:
+                        break
+                    continue
+
+                self._parse(buffer[:end])
+                self.offset += end
+                buffer = buffer[end:]
+                if at_end:
+                    break
+
+        return self.data
+
+    def _parse(self, block):
+        # the lines up to the first row, one by one
+        pos = 0
+        while self.ncol is None and pos < len(block) and not self.finished:
+            stop = block.find(b"\n", pos)
+            if stop < 0:
+                stop = len(block)
+            self._parse_lines([block[pos:stop]])
+            pos = stop + 1
+        block = block[pos:]
+        if not block or self.finished:
+            return
+
+        if self.delimiter is None and b"#" not in block:
+            self._parse_block(block)
+        else:
+            lines = block.split(b"\n")
+            if block.endswith(b"\n"):
+                lines.pop()
+            self._parse_lines(lines)
+
+    def _parse_lines(self, lines):
+        tokens = []
+        nrow = 0
+        for line in lines:
+            cells = line.split(self.delimiter)
+            if not cells:
+                if self.ncol is None:
+                    continue
+                self.finished = True
+                break
+            if self.ncol is not None and len(cells) != self.ncol:
+                self.finished = True
+                break
+            if cells[0][:1] == b"#":
+                continue
+            if self.ncol is None:
+                self.ncol = len(cells)
+            tokens.extend(cells)
             nrow += 1
-
-    results = np.vstack(results)
-    return results
-
-def loadtxt_rows(filename, rows, single_precision=False):
+        self._add(tokens, nrow)
+
+    def _parse_block(self, block):
+        # the number of columns in each line, from where the words start
+        chars = np.frombuffer(block, dtype=np.uint8)
+        # the separators of bytes.split: space, and \t \n \v \f \r
+        space = (chars == 32) | ((chars >= 9) & (chars <= 13))
+        starts = ~space
+        starts[1:] &= space[:-1]
+        ends = np.flatnonzero(chars == ord("\n"))
+        if not block.endswith(b"\n"):
+            ends = np.append(ends, len(block))
+        words = np.searchsorted(np.flatnonzero(starts), ends)
+        counts = np.diff(np.concatenate(([0], words)))
+
+        # up to the first line with a different number of columns
+        nrow = len(counts)
+        different = np.flatnonzero(counts != self.ncol)
+        if different.size > 0:
+            nrow = different[0]
+            self.finished = True
+            block = block[:ends[nrow - 1] + 1] if nrow > 0 else b""
+        if nrow == 0:
+            return
+
+        # all the numbers at once, in C; fromstring stops at a bad number,
+        # which np.array then reports
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore", DeprecationWarning)
+            values = np.fromstring(block, dtype=float, sep=" ")
+        if values.size != nrow * self.ncol:
+            values = np.array(block.split(), dtype=float)
+        self._add(values, nrow)
+
+    def _add(self, values, nrow):
+        if nrow == 0:
+            return
+        block = np.asarray(values, dtype=float).reshape(nrow, self.ncol)
+
+        if self.rows is not None:
+            first = np.searchsorted(self.rows, self.nrow)
+            last = np.searchsorted(self.rows, self.nrow + nrow)
+            keep = self.rows[first:last]
+            block = block[keep - self.nrow]
+            self.row_index.extend(keep.tolist())
+        self.nrow += nrow
+
+        if self.usecols is not None:
+            block = block[:, self.usecols]
+        self._blocks.append(np.ascontiguousarray(block, dtype=self.dtype))
+
+
+def my_loadtxt(filename, single_precision=False, delimiter=" ", usecols=None):
     """
-    Load only certain rows
+    Load quickly (only the columns `usecols`, if given)
     """
-    # Open the file
-    f = open(filename, "r")
-
-    # Storage
-    results = {}
-
-    # Row number
-    i = 0
-
-    # Number of columns
-    ncol = None
-
-    while(True):
-        # Read the line and split by whitespace
-        line = f.readline()
-        cells = line.split()
-
-        # Quit when you see a different number of columns
-        if ncol is not None and len(cells) != ncol:
-            break
-
-        # Non-comment lines
-        if cells[0] != "#":
-            # If it's the first one, get the number of columns
-            if ncol is None:
-                ncol = len(cells)
-
-            # Otherwise, include in results
-            if i in rows:
-                if single_precision:
-                    results[i] = np.array([float(cell) for cell in cells],\
-                                                              dtype="float32")
-                else:
-                    results[i] = np.array([float(cell) for cell in cells])
-            i += 1
-
-    results["ncol"] = ncol
+    loader = TextLoader(filename, usecols=usecols,
+                        single_precision=single_precision, delimiter=delimiter)
+    data = loader.update()
+    if loader.ncol is None:
+        raise IndexError("%s has no rows of numbers" % filename)
+    return data
+
+def loadtxt_rows(filename, rows, single_precision=False, usecols=None):
+    """
+    Load only certain rows, as a dictionary with one entry for each row and
+    the number of columns in "ncol"
+    """
+    loader = TextLoader(filename, usecols=usecols, rows=rows,
+                        single_precision=single_precision)
+    data = loader.update()
+    if loader.ncol is None:
+        raise IndexError("%s has no rows of numbers" % filename)
+    results = dict(zip(loader.row_index, data))
+    results["ncol"] = data.shape[1]
     return results
 
 def load_column_names(filename):
@@ -109,3 +215,41 @@ def load_column_names(filename):
 
     return {"colnames": names, "indices": indices}
 
+
+def binary_samples(setup_file="kima_model_setup.txt"):
+    """
+    Did kima write the samples to sample.bin (the binary_samples option)?
+    """
+    try:
+        with open(setup_file) as f:
+            for line in f:
+                if line.startswith("binary_samples:"):
+                    return line.split(":")[1].strip() == "true"
+    except IOError:
+        pass
+    return False
+
+
+def load_binary_samples(filename="sample.bin"):
+    """
+    Load the samples written by kima with the binary_samples option, mapped
+    from the file without copying (np.memmap). Returns the array with one
+    row per sample, as the rows of sample.txt, and the column names.
+    An incomplete last record (of a run that is still going) is left out.
+    """
+    with open(filename, "rb") as f:
+        header = f.read(64)
+        magic, version, offset, ncol, names_size = \
+            struct.unpack_from("<8sIIII", header)
+        if magic != b"KIMASMP\x00":
+            raise ValueError("%s is not a kima samples file" % filename)
+        if version != 1:
+            raise ValueError("unknown version %d of %s" % (version, filename))
+        names = f.read(names_size).rstrip(b"\x00").decode("ascii").split()
+
+    nrow = (os.path.getsize(filename) - offset) // (8 * ncol)
+    if nrow == 0:
+        return np.empty((0, ncol)), names
+    sample = np.memmap(filename, dtype="<f8", mode="r", offset=offset,
+                       shape=(nrow, ncol))
+    return sample, names
@@ -33,6 +33,34 @@ int main(int argc, char** argv)
     // the third (optional) argument, 
     // tells kima not to skip any line in the header of the file
     Data::get_instance().load(datafile, "ms", 0);
+    // or, for a binary file made with kima-rv2bin (which records the units)
+    // Data::get_instance().load_binary("data.rvb");
+    // or, to add new observations to the data of a previous run (in this
+    // directory), with the units, the lines to skip and the instrument
+    // Data::get_instance().load_setup("kima_model_setup.txt");
+    // Data::get_instance().append("new_data.txt", "ms", 0, 1);
+    // (this is a new run, from the prior, on all the data)
+
+    // to solve Kepler's equation by interpolation in a precomputed table,
+    // add kepler_solver(kepler::Solver::table) to the RVmodel constructor.
+    // The table can be saved on the first run and memory-mapped afterwards
+    // kepler::load_table("kepler_table.dat");
+
+    // for large datasets with GP = true, the celerite kernel (an O(N)
+    // approximation to the quasi-periodic kernel) is selected by adding
+    // kernel(Kernel::celerite) to the RVmodel constructor, and for datasets
+    // with long gaps, kernel(Kernel::tapered) with taper_length(5.) makes
+    // the covariance between points more than 5*eta2 apart exactly zero.
+    // For very large datasets, kernel(Kernel::inducing) with
+    // inducing_points(500) approximates it with a low-rank matrix.
+    // With block_tolerance(1e-8), the quasi-periodic kernel is factorized in
+    // independent blocks (observing seasons) separated by long gaps
+
+    // with binary_samples(true) in the RVmodel constructor, the samples are
+    // written to sample.bin (in the background) instead of sample.txt
+    // and with status_interval(60.), log(Z), the information, the effective
+    // sample size and the posterior of Np are written to kima_status.txt
+    // every minute while kima runs
     
     // set the sampler and run it!
     Sampler<RVmodel> sampler = setup<RVmodel>(argc, argv);
@@ -1,6 +1,8 @@
 import sys
 import numpy as np
 
+from .binary import is_binary, read_binary
+
 # CONSTANTS
 mjup2mearth = 317.8284065946748  # 1 Mjup in Mearth
 
@@ -39,7 +41,11 @@ def read_datafile(datafile, skip):
     identifier of the instrument.
     Or list, in which case each element will be one different filename
     containing three columns each.
+    Or a binary file written by kima-rv2bin (then `skip` is not used).
     """
+    if is_binary(datafile):
+        data, obs, _ = read_binary(datafile)
+        return data, obs
     if isinstance(datafile, list):
         data = np.empty((0,3))
         obs = np.empty((0,))
@@ -54,6 +60,29 @@ def read_datafile(datafile, skip):
         return data, obs
 
 
+def read_appended(setup):
+    """
+    Read the data files added with Data::append, as recorded in the [kima]
+    section `setup` of kima_model_setup.txt. Returns the (N,3) array of
+    times, RVs and uncertainties (in m/s) and the instrument of each point.
+    """
+    def items(key):
+        return setup.get(key, '').split(',')[:-1]
+
+    data = np.empty((0, 3))
+    obs = np.empty((0,), dtype=int)
+    for filename, units, skip, inst in zip(items('append'),
+                                           items('append_units'),
+                                           items('append_skip'),
+                                           items('append_instrument')):
+        d = np.loadtxt(filename, usecols=(0,1,2), skiprows=int(skip), ndmin=2)
+        if units == 'kms':
+            d[:, 1:] *= 1e3
+        data = np.append(data, d, axis=0)
+        obs = np.append(obs, np.full(d.shape[0], int(inst), dtype=int))
+    return data, obs
+
+
 def show_tips():
     """ Show a few tips on how to use kima """
     tips = (
@@ -34,8 +34,9 @@ setup(name='pykima',
             'kima-showresults = pykima.showresults:showresults',
             'kima-checkpriors = pykima.check_priors:main',
             'kima-template = pykima.make_template:main',
+            'kima-rv2bin = pykima.binary:main',
             ]
         },
-      package_data={'pykima': ['template/*']},
+      package_data={'pykima': ['template/*', 'libkepler.so']},
       include_package_data=True,
      )
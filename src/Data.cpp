@@ -2,76 +2,244 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
-#include <sstream>
 #include <numeric>
 #include <algorithm>
 #include <vector>
 #include <string>
 #include <set>
+#include <map>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
-typedef vector <double> record_t;
-typedef vector <record_t> data_t;
-
-
 Data Data::instance;
 
 Data::Data(){}
 
-istream& operator >> ( istream& ins, record_t& record )
-  // Let's overload the stream input operator to read a list of CSV fields (which a CSV record).
-  //-----------------------------------------------------------------------------
+
+namespace
+{
+  // A file mapped into memory (or, if that fails, read into a buffer)
+  class MappedFile
   {
-  // make sure that the returned record contains only the stuff we read now
-  record.clear();
+    public:
+      explicit MappedFile(const char* filename)
+      {
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+        {
+          size = st.st_size;
+          if (size == 0)
+            ok = true;
+          else
+          {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+              mapped = static_cast<const char*>(p);
+              ok = true;
+            }
+          }
+        }
+        close(fd);
+
+        if (!ok)
+        {
+          ifstream infile(filename, ios::binary);
+          if (infile)
+          {
+            buffer.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+            size = buffer.size();
+            ok = true;
+          }
+        }
+      }
+      ~MappedFile()
+      {
+        if (mapped)
+          munmap(const_cast<char*>(mapped), size);
+      }
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
 
-  // read the entire line into a string (a CSV record is terminated by a newline)
-  string line;
-  getline( ins, line );
+      bool good() const { return ok; }
+      const char* begin() const { return mapped ? mapped : buffer.data(); }
+      const char* end() const { return begin() + size; }
 
-  // now we'll use a stringstream to separate the fields out of the line
-  stringstream ss( line );
+    private:
+      const char* mapped {nullptr};
+      string buffer;
+      size_t size {0};
+      bool ok {false};
+  };
 
-  // convert each field to a double and 
-  // add the newly-converted field to the end of the record
-  double f;
-  while (ss >> f)
-    record.push_back(f);
 
-  // Now we have read a single line, converted into a list of fields, converted the fields
-  // from strings to doubles, and stored the results in the argument record, so
-  // we just return the argument stream as required for this kind of input overload function.
-  return ins;
+  inline bool is_separator(char c)
+  {
+    return c == ' ' || c == '\t' || c == ',' || c == '\r';
   }
 
+  // parse the number in [p, q) into x; returns false if it is not one.
+  // strtod reads the file in place, since it stops at the separator (or
+  // newline) at q; only a number that ends the file (whose end is `end`)
+  // is copied, to be terminated
+  inline bool parse_number(const char* p, const char* q, const char* end, double& x)
+  {
+    if (p == q) return false;
+    char* last;
+    if (q < end)
+    {
+      x = strtod(p, &last);
+      return last == q;
+    }
+    char buffer[64];
+    size_t n = q - p;
+    if (n >= sizeof(buffer)) return false;
+    memcpy(buffer, p, n);
+    buffer[n] = '\0';
+    x = strtod(buffer, &last);
+    return last == buffer + n;
+  }
 
-istream& operator >> ( istream& ins, data_t& data )
-  // Let's likewise overload the stream input operator to read a list of CSV records.
-  // This time it is a little easier, just because we only need to worry about reading
-  // records, and not fields.
-  //-----------------------------------------------------------------------------
+  /*
+    Read the first `ncols` columns of the text file `filename`, separated by
+    whitespace or commas, and append them to columns[0], ..., columns[ncols-1].
+    The first `skip` lines, empty lines, and lines starting with # are not
+    read, nor are any other columns. Returns false, with a message, if the
+    file can't be read, or a line has too few fields or one of its first
+    `ncols` fields is not a number (istream would have stopped there and
+    read the line short).
+  */
+  bool read_columns(const char* filename, int skip, int ncols, vector<double>* const* columns)
   {
-  // make sure that the returned data only contains the CSV data we read here
-  // data.clear();
+    MappedFile file(filename);
+    if (!file.good())
+    {
+      printf("Could not open data file (%s)!\n", filename);
+      return false;
+    }
 
-  // For every record we can read from the file, append it to our resulting data
-  // except if it's in the header
-  int i = 0;
-  record_t record;
-  while (ins >> record)
+    const char* p = file.begin();
+    const char* end = file.end();
+
+    // reserve for one row per line
+    size_t lines = count(p, end, '\n') + 1;
+    for (int k=0; k<ncols; k++)
+      columns[k]->reserve(columns[k]->size() + lines);
+
+    int line = 0;
+    while (p < end)
     {
-      data.push_back(record);
+      const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+      if (!eol) eol = end;
+      line++;
+
+      if (line > skip)
+      {
+        while (p < eol && is_separator(*p)) p++;
+        if (p < eol && *p != '#')
+        {
+          for (int k=0; k<ncols; k++)
+          {
+            while (p < eol && is_separator(*p)) p++;
+            const char* q = p;
+            while (q < eol && !is_separator(*q)) q++;
+            double x;
+            if (!parse_number(p, q, end, x))
+            {
+              if (p == q)
+                printf("Could not read data file (%s)! Line %d has %d numbers instead of %d.\n",
+                       filename, line, k, ncols);
+              else
+                printf("Could not read data file (%s)! Line %d: '%.*s' is not a number.\n",
+                       filename, line, int(q - p), p);
+              return false;
+            }
+            columns[k]->push_back(x);
+            p = q;
+          }
+        }
+      }
+      p = eol + 1;
     }
+    return true;
+  }
+
+
+  /*
+    The binary format (little-endian), written by pykima/binary.py:
+      a header of 64 bytes,
+        0  char[8]   magic, "KIMARVB" and a zero
+        8  uint32    version (1)
+        12 uint32    offset of the columns (a multiple of 64)
+        16 uint64    number of points N
+        24 uint32    number of instruments
+        28 int32     lines skipped in the text files it came from
+        32 char[8]   units of y and sig ("ms" or "kms"), zero-padded
+        40 uint32    CRC-32 of everything after the offset of the columns
+        44 uint32    size of the instrument names
+        48 uint32    size of the names of the text files
+        52 uint32    flags (1: multiple instruments)
+      the zero-terminated instrument names and text file names, and then the
+      columns t, y, sig (double) and obsi (int32), each starting at a
+      multiple of 64 bytes
+  */
+  const char BINARY_MAGIC[8] = {'K', 'I', 'M', 'A', 'R', 'V', 'B', '\0'};
+  const uint32_t BINARY_VERSION = 1;
 
-  // Again, return the argument stream
-  return ins;  
+  size_t align64(size_t n) { return (n + 63) / 64 * 64; }
+
+  // CRC-32 (the same as zlib's)
+  uint32_t crc32(const unsigned char* p, size_t n)
+  {
+    static uint32_t table[256];
+    static bool ready = false;
+    if (!ready)
+    {
+      for (uint32_t i=0; i<256; i++)
+      {
+        uint32_t c = i;
+        for (int k=0; k<8; k++)
+          c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        table[i] = c;
+      }
+      ready = true;
+    }
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i=0; i<n; i++)
+      c = table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
   }
 
+  // the zero-terminated strings in [p, p+n)
+  vector<string> split_names(const char* p, size_t n)
+  {
+    vector<string> names;
+    const char* end = p + n;
+    while (p < end)
+    {
+      size_t len = strnlen(p, end - p);
+      names.push_back(string(p, len));
+      p += len + 1;
+    }
+    return names;
+  }
+}
+
 
 void Data::load(const char* filename, const char* units, int skip)
   /* 
-  Read in tab/space separated file `filename` with columns
+  Read in tab, space or comma separated file `filename` with columns
   time  vrad  error
   ...   ...   ...
   where vrad and error are in `units` (either "kms" or "ms").
@@ -79,42 +247,31 @@ void Data::load(const char* filename, const char* units, int skip)
   */
   {
 
-  data_t data;
-
   // Empty the vectors
   t.clear();
   y.clear();
   sig.clear();
 
-  // Read the file into the data container
-  ifstream infile( filename );
-  infile >> data;
-
-  // Complain if something went wrong.
-  if (!infile.eof())
-  {
-    printf("Could not read data file (%s)!\n", filename);
+  // Read the file straight into them
+  vector<double>* columns[] = {&t, &y, &sig};
+  if (!read_columns(filename, skip, 3, columns))
     exit(1);
-  }
-
-  infile.close();
 
   datafile = filename;
   dataunits = units;
   dataskip = skip;
   datamulti = false;
+  appended.clear();
   number_instruments = 1;
 
 
   double factor = 1.;
   if(units == "kms") factor = 1E3;
 
-  for (unsigned n = 0; n < data.size(); n++)
+  for (size_t n = 0; n < t.size(); n++)
     {
-      if (n<skip) continue;
-      t.push_back(data[n][0]);
-      y.push_back(data[n][1] * factor);
-      sig.push_back(data[n][2] * factor);
+      y[n] *= factor;
+      sig[n] *= factor;
     }
 
   // How many points did we read?
@@ -122,7 +279,7 @@ void Data::load(const char* filename, const char* units, int skip)
   if(units == "kms")
     printf("# Multiplied all RVs by 1000; units are now m/s.\n");
 
-  for(unsigned i=0; i<data.size(); i++)
+  for(unsigned i=0; i<t.size(); i++)
   {
       if (t[i] > 57170.)
       {
@@ -131,13 +288,15 @@ void Data::load(const char* filename, const char* units, int skip)
       }
   }
 
+  build_view();
+
   }
 
 
 
 void Data::load_multi(const char* filename, const char* units, int skip)
   /* 
-  Read in tab/space separated file `filename` with columns
+  Read in tab, space or comma separated file `filename` with columns
   time  vrad  error  obs
   ...   ...   ...    ...
   where vrad and error are in `units` (either "kms" or "ms").
@@ -146,42 +305,33 @@ void Data::load_multi(const char* filename, const char* units, int skip)
   */
   {
 
-  data_t data;
-
   // Empty the vectors
   t.clear();
   y.clear();
   sig.clear();
   obsi.clear();
 
-  // Read the file into the data container
-  ifstream infile( filename );
-  infile >> data;
-
-  // Complain if something went wrong.
-  if (!infile.eof())
-  {
-    printf("Could not read data file (%s)!\n", filename);
+  // Read the file straight into them
+  vector<double> obs;
+  vector<double>* columns[] = {&t, &y, &sig, &obs};
+  if (!read_columns(filename, skip, 4, columns))
     exit(1);
-  }
-
-  infile.close();
 
   datafile = filename;
   dataunits = units;
   dataskip = skip;
   datamulti = true;
+  appended.clear();
 
   double factor = 1.;
   if(units == "kms") factor = 1E3;
 
-  for (unsigned n = 0; n < data.size(); n++)
+  obsi.resize(t.size());
+  for (size_t n = 0; n < t.size(); n++)
     {
-      if (n<skip) continue;
-      t.push_back(data[n][0]);
-      y.push_back(data[n][1] * factor);
-      sig.push_back(data[n][2] * factor);
-      obsi.push_back(data[n][3]);
+      y[n] *= factor;
+      sig[n] *= factor;
+      obsi[n] = obs[n];
     }
 
   // How many points did we read?
@@ -195,7 +345,7 @@ void Data::load_multi(const char* filename, const char* units, int skip)
   if(units == "kms") 
     cout << "# Multiplied all RVs by 1000; units are now m/s." << endl;
 
-  for(unsigned i=0; i<data.size(); i++)
+  for(unsigned i=0; i<t.size(); i++)
   {
       if (t[i] > 57170.)
       {
@@ -204,11 +354,13 @@ void Data::load_multi(const char* filename, const char* units, int skip)
       }
   }
 
+  build_view();
+
   }
 
 void Data::load_multi(std::vector<char*> filenames, const char* units, int skip)
 /* 
-Read in tab/space separated files `filenames`, each with columns
+Read in tab, space or comma separated files `filenames`, each with columns
 time  vrad  error
 ...   ...   ...
 where vrad and error are in `units` (either "kms" or "ms"). All files should 
@@ -216,41 +368,55 @@ have values in the same units. Skip the first `skip` lines (of all files).
 */
 {
 
-  data_t data;
-
   // Empty the vectors
   t.clear();
   y.clear();
   sig.clear();
   obsi.clear();
 
-  std::string dump; // to dump the first skip lines of each file
-  int filecount = 1;
-  int last_file_size = 0;
-
-  // Read the files into the data container
-  for (auto &filename : filenames) {
-    ifstream infile( filename );
-    for (int i=0; i<skip; i++)  // skip the first `skip` lines of each file
-      getline(infile, dump);
-    infile >> data;
+  // Read the files, in parallel, into one set of columns for each
+  size_t nfiles = filenames.size();
+  vector< vector<double> > file_t(nfiles), file_y(nfiles), file_sig(nfiles);
+  vector<char> ok(nfiles, 0);
+  atomic<size_t> next(0);
 
-    // Complain if something went wrong.
-    if (!infile.eof())
+  auto read_files = [&]()
+  {
+    size_t f;
+    while ((f = next++) < nfiles)
     {
-      printf("Could not read data file (%s)!\n", filename);
-      exit(1);
+      vector<double>* columns[] = {&file_t[f], &file_y[f], &file_sig[f]};
+      ok[f] = read_columns(filenames[f], skip, 3, columns);
     }
+  };
 
-    infile.close();
+  size_t nthreads = min<size_t>(nfiles, max(1u, thread::hardware_concurrency()));
+  vector<thread> threads;
+  for (size_t i=1; i<nthreads; i++)
+    threads.emplace_back(read_files);
+  read_files();
+  for (auto& th : threads)
+    th.join();
 
-    // Assign instrument int identifier to obsi
-    for(unsigned i=last_file_size; i<data.size(); i++){
-      obsi.push_back(filecount);
-    }
-    
-    last_file_size = data.size();
-    filecount++;
+  // Complain if something went wrong.
+  for (size_t f=0; f<nfiles; f++)
+    if (!ok[f])
+      exit(1);
+
+  // and put them together, with the instrument identifiers in obsi
+  size_t total = 0;
+  for (size_t f=0; f<nfiles; f++)
+    total += file_t[f].size();
+  t.reserve(total);
+  y.reserve(total);
+  sig.reserve(total);
+  obsi.reserve(total);
+  for (size_t f=0; f<nfiles; f++)
+  {
+    t.insert(t.end(), file_t[f].begin(), file_t[f].end());
+    y.insert(y.end(), file_y[f].begin(), file_y[f].end());
+    sig.insert(sig.end(), file_sig[f].begin(), file_sig[f].end());
+    obsi.insert(obsi.end(), file_t[f].size(), f + 1);
   }
 
   datafile = "";
@@ -258,17 +424,16 @@ have values in the same units. Skip the first `skip` lines (of all files).
   dataunits = units;
   dataskip = skip;
   datamulti = true;
+  appended.clear();
 
 
   double factor = 1.;
   if(units == "kms") factor = 1E3;
 
-  for (unsigned n=0; n<data.size(); n++)
+  for (size_t n=0; n<t.size(); n++)
     {
-      // if (n<skip) continue;
-      t.push_back(data[n][0]);
-      y.push_back(data[n][1] * factor);
-      sig.push_back(data[n][2] * factor);
+      y[n] *= factor;
+      sig[n] *= factor;
     }
 
   // How many points did we read?
@@ -320,7 +485,7 @@ have values in the same units. Skip the first `skip` lines (of all files).
     //     cout << t[i] << "\t" << y[i] << "\t" << sig[i] << "\t" << obsi[i] <<  endl;
   }
 
-  for(unsigned i=0; i<data.size(); i++)
+  for(unsigned i=0; i<t.size(); i++)
   {
       if (t[i] > 57170.)
       {
@@ -329,10 +494,381 @@ have values in the same units. Skip the first `skip` lines (of all files).
       }
   }
 
+  build_view();
+
 }
 
 
 
+void Data::load_binary(const char* filename)
+/*
+  Read the binary file `filename`, written by pykima (kima-rv2bin), which
+  contains the times, RVs, uncertainties and instruments of all points (in
+  the order the text loaders give), in columns that are copied without
+  parsing.
+*/
+{
+  MappedFile file(filename);
+  const char* p = file.begin();
+  size_t size = file.end() - file.begin();
+
+  uint32_t version, offset, ninst, crc, names_size, sources_size, flags;
+  uint64_t N;
+  int32_t skip;
+  char units[9] = {0};
+
+  if (!file.good() || size < 64 || memcmp(p, BINARY_MAGIC, 8) != 0)
+  {
+    printf("Could not read data file (%s)! It is not a kima binary file.\n", filename);
+    exit(1);
+  }
+  memcpy(&version, p + 8, 4);
+  memcpy(&offset, p + 12, 4);
+  memcpy(&N, p + 16, 8);
+  memcpy(&ninst, p + 24, 4);
+  memcpy(&skip, p + 28, 4);
+  memcpy(units, p + 32, 8);
+  memcpy(&crc, p + 40, 4);
+  memcpy(&names_size, p + 44, 4);
+  memcpy(&sources_size, p + 48, 4);
+  memcpy(&flags, p + 52, 4);
+
+  if (version != BINARY_VERSION)
+  {
+    printf("Could not read data file (%s)! Unknown version %u.\n", filename, version);
+    exit(1);
+  }
+  size_t column = align64(N * sizeof(double));
+  size_t column_int = align64(N * sizeof(int32_t));
+  if (offset < 64 + names_size + sources_size || size < offset + 3*column + column_int)
+  {
+    printf("Could not read data file (%s)! It is truncated.\n", filename);
+    exit(1);
+  }
+  if (crc32(reinterpret_cast<const unsigned char*>(p + offset), size - offset) != crc)
+  {
+    printf("Could not read data file (%s)! The checksum does not match.\n", filename);
+    exit(1);
+  }
+
+  instrument_names = split_names(p + 64, names_size);
+  vector<string> sources = split_names(p + 64 + names_size, sources_size);
+
+  t.resize(N);
+  y.resize(N);
+  sig.resize(N);
+  memcpy(t.data(), p + offset, N * sizeof(double));
+  memcpy(y.data(), p + offset + column, N * sizeof(double));
+  memcpy(sig.data(), p + offset + 2*column, N * sizeof(double));
+
+  bool multi = flags & 1;
+  obsi.clear();
+  if (multi)
+  {
+    vector<int32_t> obs(N);
+    memcpy(obs.data(), p + offset + 3*column, N * sizeof(int32_t));
+    obsi.assign(obs.begin(), obs.end());
+  }
+
+  // the units as one of the literals compared with elsewhere
+  bool kms = strcmp(units, "kms") == 0;
+
+  datafile = filename;
+  datafiles.clear();
+  dataunits = kms ? "kms" : "ms";
+  dataskip = 0;
+  datamulti = multi;
+  appended.clear();
+  number_instruments = multi ? ninst : 1;
+
+  double factor = kms ? 1E3 : 1.;
+  for (size_t n = 0; n < t.size(); n++)
+    {
+      y[n] *= factor;
+      sig[n] *= factor;
+    }
+
+  printf("# Loaded %d data points from binary file %s\n", (int) t.size(), filename);
+  if (!sources.empty())
+  {
+    printf("# converted from ");
+    for (auto& f : sources)
+      printf("%s ; ", f.c_str());
+    printf("(skipping %d lines)\n", skip);
+  }
+  if (multi)
+  {
+    printf("# RVs come from %d different instruments", number_instruments);
+    if (!instrument_names.empty())
+    {
+      printf(":");
+      for (auto& name : instrument_names)
+        printf(" %s", name.c_str());
+    }
+    printf(".\n");
+  }
+  if (kms)
+    printf("# Multiplied all RVs by 1000; units are now m/s.\n");
+
+  index_fibers = t.size();
+  for(unsigned i=0; i<t.size(); i++)
+  {
+      if (t[i] > 57170.)
+      {
+          index_fibers = i;
+          break;
+      }
+  }
+
+  build_view();
+}
+
+
+void Data::append(const char* filename, const char* units, int skip, int instrument)
+/*
+  Read in tab, space or comma separated file `filename` with columns
+  time  vrad  error
+  ...   ...   ...
+  where vrad and error are in `units` (either "kms" or "ms"), and add the
+  points to the data already loaded. With several instruments, the new points
+  come from `instrument` (an existing one, or a new one). Skip the first
+  `skip` lines. The points are kept in time order, as from load_multi.
+*/
+{
+  if (t.empty())
+  {
+    printf("Could not append data file (%s)! Load the data first.\n", filename);
+    exit(1);
+  }
+  if (instrument < 1 || (!datamulti && instrument != 1) ||
+      (datamulti && instrument > number_instruments + 1))
+  {
+    printf("Could not append data file (%s)! Instrument %d does not exist.\n", filename, instrument);
+    exit(1);
+  }
+
+  vector<double> new_t, new_y, new_sig;
+  vector<double>* columns[] = {&new_t, &new_y, &new_sig};
+  if (!read_columns(filename, skip, 3, columns))
+    exit(1);
+
+  bool kms = strcmp(units, "kms") == 0;
+  double factor = kms ? 1E3 : 1.;
+
+  size_t N0 = t.size();
+  for (size_t n=0; n<new_t.size(); n++)
+  {
+    t.push_back(new_t[n]);
+    y.push_back(new_y[n] * factor);
+    sig.push_back(new_sig[n] * factor);
+    if (datamulti)
+      obsi.push_back(instrument);
+  }
+
+  // the new points are usually the latest, otherwise sort them in
+  if (!is_sorted(t.begin() + N0 - 1, t.end()))
+  {
+    size_t N = t.size();
+    vector<size_t> order(N);
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](size_t i, size_t j){ return t[i] < t[j]; });
+
+    vector<double> tt(N), yy(N), sigsig(N);
+    vector<int> obsiobsi(obsi.size());
+    for (size_t i=0; i<N; i++)
+    {
+      tt[i] = t[order[i]];
+      yy[i] = y[order[i]];
+      sigsig[i] = sig[order[i]];
+      if (datamulti)
+        obsiobsi[i] = obsi[order[i]];
+    }
+    t.swap(tt);
+    y.swap(yy);
+    sig.swap(sigsig);
+    obsi.swap(obsiobsi);
+  }
+
+  appended.push_back({filename, kms ? "kms" : "ms", skip, instrument});
+
+  printf("# Appended %d data points from file %s", (int) new_t.size(), filename);
+  if (datamulti)
+  {
+    std::set<int> s(obsi.begin(), obsi.end());
+    number_instruments = s.size();
+    printf(" (instrument %d)", instrument);
+  }
+  printf("\n");
+  if (kms)
+    printf("# Multiplied all RVs by 1000; units are now m/s.\n");
+
+  index_fibers = t.size();
+  for(unsigned i=0; i<t.size(); i++)
+  {
+      if (t[i] > 57170.)
+      {
+          index_fibers = i;
+          break;
+      }
+  }
+
+  build_view();
+}
+
+
+void Data::load_setup(const char* filename)
+/*
+  Read the [kima] section of `filename`, written by RVmodel::save_setup, and
+  load the same data as that run (then the data can be appended to).
+*/
+{
+  ifstream fin(filename);
+  if (!fin)
+  {
+    printf("Could not open file (%s)!\n", filename);
+    exit(1);
+  }
+
+  map<string, string> options;
+  string line, section;
+  while (getline(fin, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty() || line[0] == ';' || line[0] == '#')
+      continue;
+    if (line[0] == '[')
+    {
+      section = line.substr(1, line.find(']') - 1);
+      continue;
+    }
+    size_t colon = line.find(':');
+    if (section != "kima" || colon == string::npos)
+      continue;
+    size_t begin = line.find_first_not_of(' ', colon + 1);
+    options[line.substr(0, colon)] = begin == string::npos ? "" : line.substr(begin);
+  }
+
+  // the comma-terminated lists of save_setup
+  auto split = [](const string& list)
+  {
+    vector<string> items;
+    size_t begin = 0, comma;
+    while ((comma = list.find(',', begin)) != string::npos)
+    {
+      items.push_back(list.substr(begin, comma - begin));
+      begin = comma + 1;
+    }
+    return items;
+  };
+
+  // the loaders keep pointers to the names
+  auto keep = [this](const string& name)
+  {
+    setup_names.push_back(name);
+    return &setup_names.back()[0];
+  };
+
+  if (options.count("file") == 0 || options.count("units") == 0)
+  {
+    printf("Could not find the data files in %s!\n", filename);
+    exit(1);
+  }
+  const char* units = options["units"] == "kms" ? "kms" : "ms";
+  int skip = atoi(options["skip"].c_str());
+  vector<string> files = split(options["files"]);
+
+  if (!files.empty())
+  {
+    vector<char*> names;
+    for (auto& f : files)
+      names.push_back(keep(f));
+    load_multi(names, units, skip);
+  }
+  else
+  {
+    const char* file = keep(options["file"]);
+    ifstream test(file, ios::binary);
+    char magic[8] = {0};
+    test.read(magic, 8);
+    if (memcmp(magic, BINARY_MAGIC, 8) == 0)
+      load_binary(file);
+    else if (options["multi"] == "true")
+      load_multi(file, units, skip);
+    else
+      load(file, units, skip);
+  }
+
+  vector<string> append_files = split(options["append"]);
+  vector<string> append_units = split(options["append_units"]);
+  vector<string> append_skip = split(options["append_skip"]);
+  vector<string> append_instrument = split(options["append_instrument"]);
+  if (append_units.size() != append_files.size() ||
+      append_skip.size() != append_files.size() ||
+      append_instrument.size() != append_files.size())
+  {
+    printf("The appended files in %s are incomplete!\n", filename);
+    exit(1);
+  }
+  for (size_t i=0; i<append_files.size(); i++)
+    append(append_files[i].c_str(),
+           append_units[i] == "kms" ? "kms" : "ms",
+           atoi(append_skip[i].c_str()),
+           atoi(append_instrument[i].c_str()));
+}
+
+
+void Data::build_view()
+/*
+  Copy the data into the DataView, and precompute the per-point quantities
+  used by the model.
+*/
+{
+  size_t N = t.size();
+  view.N = N;
+
+  view.t.assign(t.begin(), t.end());
+  view.y.assign(y.begin(), y.end());
+  view.sig.assign(sig.begin(), sig.end());
+
+  view.t_min = get_t_min();
+  view.t_max = get_t_max();
+  view.t_middle = get_t_middle();
+  view.sig_min = *std::min_element(sig.begin(), sig.end());
+
+  view.sig2.resize(N);
+  view.t_centered.resize(N);
+  view.t_since_first.resize(N);
+  view.instrument.resize(N);
+  for (size_t i=0; i<N; i++)
+  {
+    view.sig2[i] = sig[i]*sig[i];
+    view.t_centered[i] = t[i] - view.t_middle;
+    view.t_since_first[i] = t[i] - t[0];
+    view.instrument[i] = obsi.empty() ? 0 : obsi[i] - 1;
+  }
+  view.number_instruments = obsi.empty() ? 1 : number_instruments;
+
+  view.segments.clear();
+  for (size_t i=0; i<N; i++)
+  {
+    if (i == 0 || view.instrument[i] != view.instrument[i-1])
+      view.segments.push_back({i, i+1, view.instrument[i]});
+    else
+      view.segments.back().end = i+1;
+  }
+
+  view.index_fibers = N;
+  for (size_t i=0; i<N; i++)
+  {
+    if (t[i] > 57170.)
+    {
+      view.index_fibers = i;
+      break;
+    }
+  }
+}
+
 double Data::get_RV_var() const
 {
     double sum = std::accumulate(std::begin(y), std::end(y), 0.0);
@@ -4,7 +4,70 @@
 #include <vector>
 #include <algorithm>
 #include <set>
+#include <deque>
+#include <string>
 #include <cmath>
+#include <cstdlib>
+#include <new>
+
+// allocates memory aligned to cache lines, for the arrays of DataView
+template <typename T>
+struct aligned_allocator
+{
+	typedef T value_type;
+	static const size_t alignment = 64;
+
+	aligned_allocator() {}
+	template <typename U> aligned_allocator(const aligned_allocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		void* p = nullptr;
+		if (posix_memalign(&p, alignment, n*sizeof(T)) != 0)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+	void deallocate(T* p, size_t) { free(p); }
+
+	template <typename U> bool operator==(const aligned_allocator<U>&) const { return true; }
+	template <typename U> bool operator!=(const aligned_allocator<U>&) const { return false; }
+};
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T> >;
+
+
+// A read-only view of the data, built once after loading it, with the
+// per-point quantities needed by the model precomputed. The hot paths of
+// RVmodel borrow it with Data::get_instance().get_view()
+struct DataView
+{
+	// number of points
+	size_t N {0};
+
+	// times, RVs and uncertainties, and the squared uncertainties
+	aligned_vector<double> t, y, sig, sig2;
+	// t - t_middle, and t - t[0]
+	aligned_vector<double> t_centered, t_since_first;
+	// instrument of each point, from 0 (always 0 for a single instrument)
+	aligned_vector<int> instrument;
+
+	// a run of consecutive points from the same instrument
+	struct segment
+	{
+		size_t begin, end;
+		int instrument;
+	};
+	std::vector<segment> segments;
+
+	double t_min {0.}, t_max {0.}, t_middle {0.};
+	double sig_min {0.};
+	int number_instruments {1};
+
+	// first point after the change in HARPS fibers (N if there is none)
+	size_t index_fibers {0};
+};
+
 
 class Data
 {
@@ -12,6 +75,12 @@ class Data
 		std::vector<double> t, y, sig;
 		std::vector<int> obsi;
 
+		DataView view;
+		void build_view();
+
+		// storage for the names of the files read by load_setup
+		std::deque<std::string> setup_names;
+
 	public:
 		Data();
 		// to read data from one file, one instrument
@@ -20,6 +89,15 @@ class Data
 		void load_multi(const char* filename, const char* units, int skip=2);
 		// to read data from more than one file, more than one instrument
 		void load_multi(std::vector<char*> filenames, const char* units, int skip=2);
+		// to read data from a binary file written by pykima (kima-rv2bin),
+		// with any number of instruments
+		void load_binary(const char* filename);
+		// to add the points in `filename` (time, vrad, error) to the data
+		// already loaded, from instrument `instrument` if there are several
+		void append(const char* filename, const char* units, int skip=0, int instrument=1);
+		// to load the data of a previous run, as recorded (with what was
+		// appended) in its kima_model_setup.txt
+		void load_setup(const char* filename="kima_model_setup.txt");
 
 		int index_fibers;
 
@@ -29,6 +107,15 @@ class Data
 		int dataskip;
 		bool datamulti; // multiple instruments? not sure if needed
 		int number_instruments;
+		std::vector<std::string> instrument_names; // only from binary files
+
+		// the files added with append, in order
+		struct appended_file
+		{
+			std::string filename, units;
+			int skip, instrument;
+		};
+		std::vector<appended_file> appended;
 
 		// Getters
 		int N() const {return t.size();}
@@ -53,6 +140,9 @@ class Data
 
 		double topslope() const {return std::abs(get_y_max() - get_y_min()) / (t.back() - t.front());}
 
+		// the data, as used by the model
+		const DataView& get_view() const { return view; }
+
 	// Singleton
 	private:
 		static Data instance;
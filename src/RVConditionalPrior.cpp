@@ -8,6 +8,9 @@ using namespace std;
 using namespace DNest4;
 
 
+// the priors are defined in kima_setup.cpp (and already declared when this
+// file is compiled together with it, see the Makefiles of the examples)
+#ifndef KIMA_UNITY_BUILD
 extern ContinuousDistribution *log_muP_prior;
 extern ContinuousDistribution *wP_prior;
 extern ContinuousDistribution *log_muK_prior;
@@ -18,6 +21,7 @@ extern ContinuousDistribution *Kprior;
 extern ContinuousDistribution *eprior;
 extern ContinuousDistribution *phiprior;
 extern ContinuousDistribution *wprior;
+#endif
 
 
 RVConditionalPrior::RVConditionalPrior()
@@ -128,3 +132,13 @@ void RVConditionalPrior::print(std::ostream& out) const
     if(hyperpriors)
         out<<center<<' '<<width<<' '<<muK<<' ';
 }
+
+void RVConditionalPrior::print(std::vector<double>& out) const
+{
+    if(hyperpriors)
+    {
+        out.push_back(center);
+        out.push_back(width);
+        out.push_back(muK);
+    }
+}
@@ -29,6 +29,8 @@ class RVConditionalPrior:public DNest4::ConditionalPrior
 		void to_uniform(std::vector<double>& vec) const;
 
 		void print(std::ostream& out) const;
+		// the values print writes, for the binary samples
+		void print(std::vector<double>& out) const;
 		static const int weight_parameter = 1;
 
 };
@@ -9,6 +9,8 @@
 #include <fstream>
 #include <chrono>
 #include <time.h> 
+#include <mutex>
+#include <algorithm>
 
 using namespace std;
 using namespace Eigen;
@@ -16,6 +18,17 @@ using namespace DNest4;
 
 #define TIMING false
 
+// compare the residuals with a recalculation in long double before they are
+// recalculated from scratch (see calculate_mu), in builds without NDEBUG
+#ifdef NDEBUG
+#define CHECK_RESIDUALS false
+#else
+#define CHECK_RESIDUALS true
+#endif
+
+// the priors are defined in kima_setup.cpp (and already declared when this
+// file is compiled together with it, see the Makefiles of the examples)
+#ifndef KIMA_UNITY_BUILD
 extern ContinuousDistribution *Cprior; // systematic velocity, m/s
 extern ContinuousDistribution *Jprior; // additional white noise, m/s
 
@@ -27,6 +40,7 @@ extern ContinuousDistribution *log_eta1_prior;
 extern ContinuousDistribution *log_eta2_prior;
 extern ContinuousDistribution *eta3_prior;
 extern ContinuousDistribution *log_eta4_prior;
+#endif
 
 
 
@@ -69,50 +83,166 @@ void RVmodel::from_prior(RNG& rng)
         eta4 = exp(log_eta4_prior->generate(rng));
     }
 
-    calculate_mu();
+    calculate_mu(true);
 
     if(GP) calculate_C();
-    
+
+    if(marginalize_systematics)
+    {
+        setup_linear_priors();
+        for(auto& z : linear_z)
+            z = rng.randn();
+    }
 }
 
 void RVmodel::calculate_C()
 {
     // Get the data
-    auto data = Data::get_instance();
-    const vector<double>& t = data.get_t();
-    const vector<double>& sig = data.get_sig();
-    const vector<int>& obsi = data.get_obsi();
-    int N = data.N();
+    const DataView& data = Data::get_instance().get_view();
+    const auto& t = data.t;
+    const auto& sig2 = data.sig2;
+    const auto& instrument = data.instrument;
+    size_t N = data.N;
     double jit;
 
     #if TIMING
     auto begin = std::chrono::high_resolution_clock::now();  // start timing
     #endif
 
-    for(size_t i=0; i<N; i++)
+    if(kernel == Kernel::celerite)
     {
-        for(size_t j=i; j<N; j++)
+        // the matrix is never built, only its semiseparable factorization
+        if(celerite_gp.size() != N)
+            celerite_gp.set_times(t.data(), N);
+
+        celerite::Terms terms;
+        celerite::quasi_periodic(eta1, eta2, eta3, eta4, celerite_harmonics, terms);
+
+        vector<double> diagonal(N);
+        for(size_t i=0; i<N; i++)
         {
-            C(i, j) = eta1*eta1*exp(-0.5*pow((t[i] - t[j])/eta2, 2) 
-                        -2.0*pow(sin(M_PI*(t[i] - t[j])/eta3)/eta4, 2) );
+            jit = multi_instrument ? jitters[instrument[i]] : extra_sigma;
+            diagonal[i] = sig2[i] + jit*jit;
+        }
+        C_ok = celerite_gp.factor(terms, diagonal.data());
+        C_logdet = celerite_gp.log_determinant();
+    }
+    else if(kernel == Kernel::tapered)
+    {
+        // the time order is the fill-reducing ordering, found once
+        if(tapered_gp.size() != N)
+            tapered_gp.set_times(t.data(), N);
 
-            if(i==j)
+        vector<double> diagonal(N);
+        for(size_t i=0; i<N; i++)
+        {
+            jit = multi_instrument ? jitters[instrument[i]] : extra_sigma;
+            diagonal[i] = sig2[i] + jit*jit;
+        }
+        C_ok = tapered_gp.factor(eta1, eta2, eta3, eta4, taper_length*eta2,
+                                 diagonal.data());
+        C_logdet = tapered_gp.log_determinant();
+    }
+    else if(kernel == Kernel::inducing)
+    {
+        // the inducing points are chosen once
+        if(inducing_gp.size() != N)
+        {
+            inducing_gp.set_times(t.data(), N, inducing_points);
+            printf("# Inducing-point GP with %d inducing points\n",
+                   (int) inducing_gp.inducing_points());
+        }
+
+        vector<double> diagonal(N);
+        for(size_t i=0; i<N; i++)
+        {
+            jit = multi_instrument ? jitters[instrument[i]] : extra_sigma;
+            diagonal[i] = sig2[i] + jit*jit;
+        }
+        C_ok = inducing_gp.factor(eta1, eta2, eta3, eta4, diagonal.data());
+        C_logdet = inducing_gp.log_determinant();
+    }
+    else
+    {
+        // Only the parts of C that depend on the hyperparameters that
+        // changed since the last call are recalculated: all of it if eta2,
+        // eta3 or eta4 changed, a scaling of the off-diagonal elements if
+        // only eta1 changed, and always the diagonal, which is cheap
+        bool sweep = C_eta.empty() || eta2 != C_eta[1] || eta3 != C_eta[2]
+                                   || eta4 != C_eta[3];
+
+        // the blocks only change with eta2, and then all of C is swept
+        bool blocks = block_tolerance > 0.;
+        if(blocks)
+            update_blocks(eta2);
+
+        if(sweep)
+        {
+            // sin^2(pi (t_i - t_j)/eta3) = (s_i c_j - c_i s_j)^2, with
+            // s_i = sin(pi t_i/eta3), c_i = cos(pi t_i/eta3), so that the
+            // only transcendental function left for each pair is one exp
+            if(C_eta.empty() || eta3 != C_eta[2])
             {
-                if (multi_instrument)
+                C_sin.resize(N);
+                C_cos.resize(N);
+                for(size_t i=0; i<N; i++)
                 {
-                    jit = jitters[obsi[i]-1];
-                    C(i, j) += sig[i]*sig[i] + jit*jit;
+                    C_sin[i] = sin(M_PI*data.t_centered[i]/eta3);
+                    C_cos[i] = cos(M_PI*data.t_centered[i]/eta3);
                 }
-                else
+            }
+
+            double amp = eta1*eta1;
+            double a = -0.5/(eta2*eta2);
+            double b = -2.0/(eta4*eta4);
+            for(size_t j=0; j<N; j++)
+            {
+                for(size_t i=j+1; i<N; i++)
                 {
-                    C(i, j) += sig[i]*sig[i] + extra_sigma*extra_sigma;
+                    // elements between blocks are not needed
+                    if(blocks && C_block[i] != C_block[j])
+                        continue;
+                    double dt = t[i] - t[j];
+                    double s = C_sin[i]*C_cos[j] - C_cos[i]*C_sin[j];
+                    C(i, j) = amp*exp(a*dt*dt + b*s*s);
+                    C(j, i) = C(i, j);
                 }
             }
-            else
+        }
+        else if(eta1 != C_eta[0])
+        {
+            double scale = (eta1*eta1) / (C_eta[0]*C_eta[0]);
+            for(size_t j=0; j<N; j++)
             {
-                C(j, i) = C(i, j);
+                for(size_t i=j+1; i<N; i++)
+                {
+                    C(i, j) *= scale;
+                    C(j, i) = C(i, j);
+                }
             }
         }
+
+        for(size_t i=0; i<N; i++)
+        {
+            jit = multi_instrument ? jitters[instrument[i]] : extra_sigma;
+            C(i, i) = eta1*eta1 + sig2[i] + jit*jit;
+        }
+
+        C_eta = {eta1, eta2, eta3, eta4};
+
+        // the factorization is only needed again when C changes
+        if(blocks)
+        {
+            C_ok = C_blocks.compute(C, cholesky_threads, cholesky_threshold,
+                                    cholesky_precision);
+            C_logdet = C_blocks.log_determinant();
+        }
+        else
+        {
+            C_ok = C_cholesky.compute(C, cholesky_threads, cholesky_threshold,
+                                      cholesky_precision);
+            C_logdet = C_cholesky.log_determinant();
+        }
     }
 
     #if TIMING
@@ -123,69 +253,179 @@ void RVmodel::calculate_C()
     #endif
 }
 
-void RVmodel::calculate_mu()
+void RVmodel::whiten(const double* y, double* z) const
 {
-    auto data = Data::get_instance();
-    // Get the times from the data
-    const vector<double>& t = data.get_t();
-    // only really needed if multi_instrument
-    const vector<int>& obsi = data.get_obsi();
+    if(kernel == Kernel::celerite)
+        celerite_gp.whiten(y, z);
+    else
+        tapered_gp.whiten(y, z);
+}
 
-    // Update or from scratch?
-    bool update = (planets.get_added().size() < planets.get_components().size()) &&
-            (staleness <= 10);
+bool RVmodel::update_blocks(double eta2)
+{
+    if(!C_block.empty() && eta2 >= C_eta2_min && eta2 < C_eta2_max)
+        return false;
 
-    // Get the components
-    const vector< vector<double> >& components = (update)?(planets.get_added()):
-                (planets.get_components());
-    // at this point, components has:
-    //  if updating: only the added planets' parameters
-    //  if from scratch: all the planets' parameters
+    const DataView& data = Data::get_instance().get_view();
+    const auto& t = data.t;
+    size_t N = data.N;
 
-    // Zero the signal
-    if(!update) // not updating, means recalculate everything
+    if(block_tolerance >= 1.)
     {
-        mu.assign(mu.size(), background);
-        staleness = 0;
-        if(trend) 
+        printf("block_tolerance must be between 0 and 1\n");
+        exit(1);
+    }
+
+    // the kernel is below block_tolerance*eta1^2 for time lags longer than
+    // factor*eta2, so a gap g splits the data while eta2 < g/factor
+    double factor = sqrt(-2.*log(block_tolerance));
+
+    vector<size_t> order(N);
+    for(size_t i=0; i<N; i++) order[i] = i;
+    sort(order.begin(), order.end(), [&](size_t i, size_t j){ return t[i] < t[j]; });
+
+    C_block.assign(N, 0);
+    C_eta2_min = 0.;
+    C_eta2_max = numeric_limits<double>::infinity();
+    int block = 0;
+    for(size_t k=1; k<N; k++)
+    {
+        double gap = t[order[k]] - t[order[k-1]];
+        if(gap > factor*eta2)
         {
-            for(size_t i=0; i<t.size(); i++)
-            {
-                mu[i] += slope*(t[i] - data.get_t_middle());
-            }
+            block++;
+            C_eta2_max = min(C_eta2_max, gap/factor);
         }
+        else
+            C_eta2_min = max(C_eta2_min, gap/factor);
+        C_block[order[k]] = block;
+    }
+    C_blocks.set_blocks(C_block);
+
+    static std::once_flag logged;
+    std::call_once(logged, [&]{
+        printf("# GP covariance split at gaps longer than %.3g eta2 "
+               "(dropped covariance below %g eta1^2), now in %d blocks\n",
+               factor, block_tolerance, block + 1);
+    });
+    return true;
+}
+
+void RVmodel::solve_C(Ref<MatrixXd> B) const
+{
+    if(kernel == Kernel::inducing)
+        inducing_gp.solve(B);
+    else if(block_tolerance > 0.)
+        C_blocks.solve(B);
+    else
+        C_cholesky.solve(C, B);
+}
+
+double RVmodel::quadratic_C(const VectorXd& r) const
+{
+    if(kernel == Kernel::inducing)
+        return inducing_gp.quadratic(r);
+    else if(block_tolerance > 0.)
+        return C_blocks.quadratic(r);
+    else
+        return C_cholesky.quadratic(C, r);
+}
+
+void RVmodel::report_inducing(const VectorXd& r) const
+{
+    if(inducing_check == 0 || !C_ok)
+        return;
+
+    static std::once_flag reported;
+    std::call_once(reported, [&]{
+        double exact, approx;
+        inducing_gp.compare(r, inducing_check, exact, approx);
+        printf("# Inducing-point GP: log-likelihood on %d points is %f, exact %f (error %.3g)\n",
+               (int) std::min(inducing_check, (size_t) r.size()), approx, exact, approx - exact);
+    });
+}
+
+void RVmodel::calculate_mu(bool from_scratch)
+{
+    // Get the times from the data
+    const DataView& data = Data::get_instance().get_view();
+    const auto& t = data.t;
 
-        if(multi_instrument)
+    // Get the components
+    const vector< vector<double> >& components = planets.get_components();
+
+    // Match the planets to the cached signals, by their parameters.
+    // Cached signals left without a match belong to planets that were
+    // removed or perturbed, and planets without a match are new.
+    vector<bool> cached(components.size(), false);
+    vector<bool> used(planet_pars.size(), false);
+    for(size_t j=0; j<components.size(); j++)
+    {
+        for(size_t k=0; k<planet_pars.size(); k++)
         {
-            for(size_t j=0; j<offsets.size(); j++)
+            if(!used[k] && planet_pars[k] == components[j])
             {
-                for(size_t i=0; i<t.size(); i++)
-                {   
-                    if (obsi[i] == j+1) { mu[i] += offsets[j]; }
-                }
+                used[k] = cached[j] = true;
+                break;
             }
         }
+    }
+
+    // Update or from scratch?
+    bool update = !from_scratch && (staleness <= 10);
+
+    if(!update) // not updating, means recalculate everything
+    {
+        staleness = 0;
+        vector<double> model(t.size(), 0.);
 
-        if(obs_after_HARPS_fibers)
+        // the cached planets only need to be added back
+        for(size_t k=0; k<planet_mu.size(); k++)
         {
-            for(size_t i=data.index_fibers; i<t.size(); i++)
-            {
-                mu[i] += fiber_offset;
-            }
+            if(!used[k]) continue;
+            for(size_t i=0; i<t.size(); i++)
+                model[i] += planet_mu[k][i];
         }
 
-
+        residuals.reset(data.y.data(), model, mu_precision, data.instrument.data());
     }
-    else // just updating (adding) planets
+    else // just updating, subtract the planets that are gone
+    {
         staleness++;
+        for(size_t k=0; k<planet_mu.size(); k++)
+        {
+            if(!used[k])
+                residuals.subtract(planet_mu[k]);
+        }
+    }
 
     #if TIMING
     auto begin = std::chrono::high_resolution_clock::now();  // start timing
     #endif
 
-    double P, K, phi, ecc, omega, f, v, ti;
+    // error budget for the Keplerian signal, in m/s
+    double tolerance = kepler_tolerance * data.sig_min;
+
+    // calculate the signal of the new planets, reusing the free slots
+    double P, K, phi, ecc, omega;
+    size_t slot = 0;
     for(size_t j=0; j<components.size(); j++)
     {
+        if(cached[j]) continue;
+
+        while(slot < used.size() && used[slot]) slot++;
+        if(slot == used.size())
+        {
+            planet_pars.push_back(components[j]);
+            planet_mu.push_back(vector<double>(t.size()));
+            used.push_back(true);
+        }
+        else
+        {
+            planet_pars[slot] = components[j];
+            used[slot] = true;
+        }
+
         if(hyperpriors)
             P = exp(components[j][0]);
         else
@@ -196,14 +436,43 @@ void RVmodel::calculate_mu()
         ecc = components[j][3];
         omega = components[j][4];
 
-        for(size_t i=0; i<t.size(); i++)
-        {
-            ti = t[i];
-            f = true_anomaly(ti, P, ecc, t[0]-(P*phi)/(2.*M_PI));
-            v = K*(cos(f+omega) + ecc*cos(omega));
-            mu[i] += v;
-        }
+        // all times in one (vectorized) call; circular and low-eccentricity
+        // orbits avoid solving Kepler's equation. Times are relative to t[0]
+        kepler::keplerian(data.t_since_first.data(), t.size(), P, K, ecc, omega,
+                          -(P*phi)/(2.*M_PI), planet_mu[slot].data(),
+                          tolerance, kepler_solver);
+        residuals.add(planet_mu[slot]);
+    }
+
+    // drop the slots of planets that are gone
+    for(size_t k=used.size(); k-- > 0; )
+    {
+        if(used[k]) continue;
+        planet_pars.erase(planet_pars.begin() + k);
+        planet_mu.erase(planet_mu.begin() + k);
+    }
+
+    #if CHECK_RESIDUALS
+    // the updates have accumulated the most rounding error, which is
+    // relative to the largest of the stored residuals (and in compensated
+    // precision, of the RVs) and the planet signals
+    if(staleness == 10)
+    {
+        bool single = mu_precision == Residuals::Precision::single;
+        double scale = residuals.largest();
+        if(!single)
+            for(double yi : data.y)
+                scale = std::max(scale, std::abs(yi));
+        for(const auto& mu : planet_mu)
+            for(double m : mu)
+                scale = std::max(scale, std::abs(m));
+        double error = check_residuals();
+        if(error > (single ? 1e-6 : 1e-14) * scale)
+            printf("# Residuals differ by %g m/s from their recalculation in long double\n", error);
     }
+    #endif
+
+    if(!GP) calculate_sums();
 
     #if TIMING
     auto end = std::chrono::high_resolution_clock::now();
@@ -212,13 +481,343 @@ void RVmodel::calculate_mu()
 
 }
 
+// The signal of the systematics at each time: the systemic velocity, and
+// the trend, instrument offsets and fiber offset, if present
+void RVmodel::calculate_systematics(vector<double>& model) const
+{
+    const DataView& data = Data::get_instance().get_view();
+
+    model.assign(data.N, background);
+
+    if(trend)
+    {
+        for(size_t i=0; i<data.N; i++)
+            model[i] += slope*data.t_centered[i];
+    }
+
+    if(multi_instrument)
+    {
+        // the last instrument is the reference, without an offset
+        for(const auto& s : data.segments)
+        {
+            if (size_t(s.instrument) >= offsets.size()) continue;
+            for(size_t i=s.begin; i<s.end; i++)
+                model[i] += offsets[s.instrument];
+        }
+    }
+
+    if(obs_after_HARPS_fibers)
+    {
+        for(size_t i=data.index_fibers; i<data.N; i++)
+            model[i] += fiber_offset;
+    }
+}
+
+// Weighted sums of the residuals (without systematics) for each group of
+// points sharing the same systematics, i.e. each instrument before and after
+// the change in HARPS fibers. The sums are centred on the weighted means of
+// each group, so that the white-noise likelihood can be evaluated from them
+// for any systematics without loss of precision.
+void RVmodel::calculate_sums()
+{
+    const DataView& data = Data::get_instance().get_view();
+    const auto& tc = data.t_centered;
+    const auto& sig2 = data.sig2;
+    const auto& instrument = data.instrument;
+
+    sums.assign(2*data.number_instruments, residual_sums());
+    sum_log_var = 0.;
+
+    vector<double> r(data.N), w(data.N);
+    vector<int> group(data.N);
+    residuals.copy_to(r.data());
+    for(size_t i=0; i<data.N; i++)
+    {
+        double jit = multi_instrument ? jitters[instrument[i]] : extra_sigma;
+        double var = sig2[i] + jit*jit;
+        sum_log_var += log(var);
+        w[i] = 1./var;
+        group[i] = 2*instrument[i];
+        if(obs_after_HARPS_fibers && i >= data.index_fibers) group[i]++;
+
+        residual_sums& S = sums[group[i]];
+        S.w += w[i];
+        S.r += w[i]*r[i];
+        S.t += w[i]*tc[i];
+    }
+
+    for(auto& S : sums)
+    {
+        if(S.w == 0.) continue;
+        S.r /= S.w;
+        S.t /= S.w;
+    }
+
+    for(size_t i=0; i<data.N; i++)
+    {
+        residual_sums& S = sums[group[i]];
+        double dr = r[i] - S.r;
+        double dt = tc[i] - S.t;
+        S.rr += w[i]*dr*dr;
+        S.rt += w[i]*dr*dt;
+        S.tt += w[i]*dt*dt;
+    }
+}
+
+// Largest difference between the residuals and a recalculation from
+// scratch in long double, in m/s
+double RVmodel::check_residuals() const
+{
+    const auto& y = Data::get_instance().get_view().y;
+    vector<double> r(y.size());
+    residuals.copy_to(r.data());
+
+    double error = 0.;
+    for(size_t i=0; i<y.size(); i++)
+    {
+        long double mu = 0.;
+        for(size_t k=0; k<planet_mu.size(); k++)
+            mu += planet_mu[k][i];
+        long double exact = y[i] - mu;
+        error = std::max(error, double(std::abs(exact - r[i])));
+    }
+    return error;
+}
+
+// Sum of the chi-square of each group of points, from the sums of the
+// residuals, for the given values of the systematics
+double RVmodel::sums_chi2(double background, const vector<double>& offsets,
+                          double fiber_offset, double slope) const
+{
+    double b = trend ? slope : 0.;
+    double chi2 = 0.;
+    for(size_t g=0; g<sums.size(); g++)
+    {
+        const residual_sums& S = sums[g];
+        if(S.w == 0.) continue;
+
+        // systemic velocity, instrument offset and fiber offset
+        size_t j = g / 2;
+        double c = background;
+        if(multi_instrument && j < offsets.size())
+            c += offsets[j];
+        if(g % 2 == 1)
+            c += fiber_offset;
+
+        double d = S.r - c - b*S.t;
+        chi2 += S.w*d*d + S.rr - 2.*b*S.rt + b*b*S.tt;
+    }
+    return chi2;
+}
+
+// Read the priors of the linear parameters, in the order background,
+// offsets, fiber offset and slope. Uniform priors are taken as flat (the
+// likelihood is assumed to vanish at their bounds) and Gaussian priors are
+// included exactly.
+void RVmodel::setup_linear_priors()
+{
+    vector<ContinuousDistribution*> priors {Cprior};
+    if(multi_instrument)
+        priors.insert(priors.end(), offsets.size(), offsets_prior);
+    if(obs_after_HARPS_fibers)
+        priors.push_back(fiber_offset_prior);
+    if(trend)
+        priors.push_back(slope_prior);
+
+    size_t p = priors.size();
+    linear_mean.assign(p, 0.);
+    linear_precision.assign(p, 0.);
+    linear_z.resize(p);
+    linear_log_norm = 0.;
+
+    for(size_t k=0; k<p; k++)
+    {
+        const ContinuousDistribution* prior = priors[k];
+        double center = prior->cdf_inverse(0.5);
+        if(dynamic_cast<const Uniform*>(prior))
+        {
+            linear_log_norm += prior->log_pdf(center);
+        }
+        else if(dynamic_cast<const Gaussian*>(prior))
+        {
+            // from the log density at the center and one sigma away
+            double s = prior->cdf_inverse(0.8413447460685429) - center;
+            double f0 = prior->log_pdf(center);
+            double fp = prior->log_pdf(center + s), fm = prior->log_pdf(center - s);
+            double precision = (2.*f0 - fp - fm) / (s*s);
+            linear_precision[k] = precision;
+            linear_mean[k] = center + (fp - fm) / (2.*s*s*precision);
+            linear_log_norm += 0.5*log(precision) - halflog2pi;
+        }
+        else
+        {
+            printf("To marginalize the systematics, their priors must be Uniform or Gaussian\n");
+            exit(1);
+        }
+    }
+}
+
+/*
+    The parameters that enter the model linearly, theta = (background,
+    offsets, fiber offset, slope), have a Gaussian conditional posterior
+    given all the others, N(mean, A^-1), with A = L L^T. This calculates
+    mean and L, and returns the log-likelihood integrated over theta,
+        log int L(theta) prior(theta) dtheta
+    which is Gaussian in theta, so that the integral is analytic.
+*/
+double RVmodel::fit_systematics(VectorXd& mean, MatrixXd& L) const
+{
+    const DataView& data = Data::get_instance().get_view();
+    size_t p = linear_mean.size();
+    size_t n_offsets = multi_instrument ? offsets.size() : 0;
+    size_t i_fiber = 1 + n_offsets;
+    size_t i_slope = i_fiber + (obs_after_HARPS_fibers ? 1 : 0);
+
+    // normal equations, A theta = b
+    MatrixXd A = MatrixXd::Zero(p, p);
+    VectorXd b = VectorXd::Zero(p);
+
+    // GP: design matrix and residuals, and with the celerite and tapered
+    // kernels their whitened versions, so that X^T C^-1 X = Y^T Y
+    MatrixXd X, Y;
+    VectorXd r, z;
+
+    if(GP)
+    {
+        X = MatrixXd::Zero(data.N, p);
+        r.resize(data.N);
+        residuals.copy_to(r.data());
+        for(size_t i=0; i<data.N; i++)
+        {
+            X(i, 0) = 1.;
+            if(size_t(data.instrument[i]) < n_offsets)
+                X(i, 1 + data.instrument[i]) = 1.;
+            if(obs_after_HARPS_fibers && i >= data.index_fibers)
+                X(i, i_fiber) = 1.;
+            if(trend)
+                X(i, i_slope) = data.t_centered[i];
+        }
+
+        if(kernel == Kernel::celerite || kernel == Kernel::tapered)
+        {
+            Y.resize(data.N, p);
+            z.resize(data.N);
+            for(size_t k=0; k<p; k++)
+                whiten(X.col(k).data(), Y.col(k).data());
+            whiten(r.data(), z.data());
+            A = Y.transpose() * Y;
+            b = Y.transpose() * z;
+        }
+        else
+        {
+            MatrixXd CX = X;
+            solve_C(CX);
+            A = X.transpose() * CX;
+            b = CX.transpose() * r;
+        }
+    }
+    else
+    {
+        // each group of points contributes W u u^T to A, where u is its
+        // row of the design matrix at its mean time
+        for(size_t g=0; g<sums.size(); g++)
+        {
+            const residual_sums& S = sums[g];
+            if(S.w == 0.) continue;
+
+            VectorXd u = VectorXd::Zero(p);
+            u(0) = 1.;
+            if(g/2 < n_offsets)
+                u(1 + g/2) = 1.;
+            if(g % 2 == 1)
+                u(i_fiber) = 1.;
+            if(trend)
+                u(i_slope) = S.t;
+
+            A += S.w * u * u.transpose();
+            b += S.w * S.r * u;
+            if(trend)
+            {
+                A(i_slope, i_slope) += S.tt;
+                b(i_slope) += S.rt;
+            }
+        }
+    }
+
+    // the priors
+    for(size_t k=0; k<p; k++)
+    {
+        A(k, k) += linear_precision[k];
+        b(k) += linear_precision[k] * linear_mean[k];
+    }
+
+    Eigen::LLT<Eigen::MatrixXd> llt(A);
+    L = llt.matrixL();
+    mean = llt.solve(b);
+
+    double logL;
+    if(GP)
+    {
+        double chi2;
+        if(kernel == Kernel::celerite || kernel == Kernel::tapered)
+            chi2 = (z - Y*mean).squaredNorm();
+        else
+        {
+            chi2 = quadratic_C(r - X*mean);
+            if(kernel == Kernel::inducing)
+                report_inducing(r - X*mean);
+        }
+        logL = - halflog2pi*data.N - 0.5*C_logdet - 0.5*chi2;
+    }
+    else
+    {
+        double bg, fib, slp;
+        vector<double> offs;
+        unpack_systematics(mean, bg, offs, fib, slp);
+        logL = - halflog2pi*data.N - 0.5*sum_log_var
+               - 0.5*sums_chi2(bg, offs, fib, slp);
+    }
+
+    // prior at the mean, and the Gaussian integral over theta
+    double prior_chi2 = 0.;
+    for(size_t k=0; k<p; k++)
+        prior_chi2 += linear_precision[k] * pow(mean(k) - linear_mean[k], 2);
+    double logDetA = 0.;
+    for(size_t k=0; k<p; k++)
+        logDetA += 2.*log(L(k,k));
+
+    return logL - 0.5*prior_chi2 + linear_log_norm + halflog2pi*p - 0.5*logDetA;
+}
+
+// Split a vector of the linear parameters into its parts
+void RVmodel::unpack_systematics(const VectorXd& theta, double& background,
+                                 vector<double>& offsets,
+                                 double& fiber_offset, double& slope) const
+{
+    size_t k = 0;
+    background = theta(k++);
+    offsets.assign(this->offsets.size(), 0.);
+    if(multi_instrument)
+    {
+        for(size_t j=0; j<offsets.size(); j++)
+            offsets[j] = theta(k++);
+    }
+    fiber_offset = obs_after_HARPS_fibers ? theta(k++) : 0.;
+    slope = trend ? theta(k++) : 0.;
+}
+
 double RVmodel::perturb(RNG& rng)
 {
-    auto data = Data::get_instance();
-    const vector<double>& t = data.get_t();
-    const vector<int>& obsi = data.get_obsi();
     double logH = 0.;
 
+    // the systematics are not sampled when integrated out, only drawn from
+    // their conditional posterior for each saved sample
+    if(marginalize_systematics)
+    {
+        for(auto& z : linear_z)
+            z = rng.randn();
+    }
+
     if(GP)
     {
         if(rng.rand() <= 0.5)
@@ -254,7 +853,7 @@ double RVmodel::perturb(RNG& rng)
 
             calculate_C();
         }
-        else if(rng.rand() <= 0.5)
+        else if(marginalize_systematics || rng.rand() <= 0.5)
         {
             if(multi_instrument)
             {
@@ -269,22 +868,8 @@ double RVmodel::perturb(RNG& rng)
         }
         else
         {
-            for(size_t i=0; i<mu.size(); i++)
-            {
-                mu[i] -= background;
-                if(trend) {
-                    mu[i] -= slope*(t[i]-data.get_t_middle());
-                }
-                if(multi_instrument) {
-                    for(size_t j=0; j<offsets.size(); j++){
-                        if (obsi[i] == j+1) { mu[i] -= offsets[j]; }
-                    }
-                }
-                if (obs_after_HARPS_fibers) {
-                    if (i >= data.index_fibers) mu[i] -= fiber_offset;
-                }
-            }
-
+            // the residuals don't include the systematics, so nothing
+            // else needs to be updated
             Cprior->perturb(background, rng);
 
             // propose new instrument offsets
@@ -302,22 +887,6 @@ double RVmodel::perturb(RNG& rng)
             if(trend) {
                 slope_prior->perturb(slope, rng);
             }
-
-            for(size_t i=0; i<mu.size(); i++)
-            {
-                mu[i] += background;
-                if(trend) {
-                    mu[i] += slope*(t[i]-data.get_t_middle());
-                }
-                if(multi_instrument) {
-                    for(size_t j=0; j<offsets.size(); j++){
-                        if (obsi[i] == j+1) { mu[i] += offsets[j]; }
-                    }
-                }
-                if (obs_after_HARPS_fibers) {
-                    if (i >= data.index_fibers) mu[i] += fiber_offset;
-                }
-            }
         }
 
     }
@@ -330,7 +899,7 @@ double RVmodel::perturb(RNG& rng)
             planets.consolidate_diff();
             calculate_mu();
         }
-        else if(rng.rand() <= 0.5)
+        else if(marginalize_systematics || rng.rand() <= 0.5)
         {
             if(multi_instrument)
             {
@@ -341,25 +910,12 @@ double RVmodel::perturb(RNG& rng)
             {
                 Jprior->perturb(extra_sigma, rng);
             }
+            calculate_sums();
         }
         else
         {
-            for(size_t i=0; i<mu.size(); i++)
-            {
-                mu[i] -= background;
-                if(trend) {
-                    mu[i] -= slope*(t[i]-data.get_t_middle());
-                }
-                if(multi_instrument) {
-                    for(size_t j=0; j<offsets.size(); j++){
-                        if (obsi[i] == j+1) { mu[i] -= offsets[j]; }
-                    }
-                }
-                if (obs_after_HARPS_fibers) {
-                    if (i >= data.index_fibers) mu[i] -= fiber_offset;
-                }
-            }
-
+            // the residuals don't include the systematics, so nothing
+            // else needs to be updated
             Cprior->perturb(background, rng);
 
             // propose new instrument offsets
@@ -378,22 +934,6 @@ double RVmodel::perturb(RNG& rng)
             if(trend) {
                 slope_prior->perturb(slope, rng);
             }
-
-            for(size_t i=0; i<mu.size(); i++)
-            {
-                mu[i] += background;
-                if(trend) {
-                    mu[i] += slope*(t[i]-data.get_t_middle());
-                }
-                if(multi_instrument) {
-                    for(size_t j=0; j<offsets.size(); j++){
-                        if (obsi[i] == j+1) { mu[i] += offsets[j]; }
-                    }
-                }
-                if (obs_after_HARPS_fibers) {
-                    if (i >= data.index_fibers) mu[i] += fiber_offset;
-                }
-            }
         }
     }
 
@@ -405,44 +945,46 @@ double RVmodel::perturb(RNG& rng)
 double RVmodel::log_likelihood() const
 {
     double logL = 0.;
-    auto data = Data::get_instance();
-    int N = data.N();
-    const vector<double>& y = data.get_y();
-    const vector<double>& sig = data.get_sig();
-    const vector<int>& obsi = data.get_obsi();
-    
+    const DataView& data = Data::get_instance().get_view();
+    const auto& y = data.y;
 
     #if TIMING
     auto begin = std::chrono::high_resolution_clock::now();  // start timing
     #endif
 
-    if(GP)
+    if(marginalize_systematics)
+    {
+        VectorXd mean;
+        MatrixXd L;
+        logL = fit_systematics(mean, L);
+    }
+    else if(GP)
     {
         /** The following code calculates the log likelihood in the case of a GP model */
         // residual vector (observed y minus model y)
+        vector<double> systematics;
+        calculate_systematics(systematics);
         VectorXd residual(y.size());
+        residuals.copy_to(residual.data());
         for(size_t i=0; i<y.size(); i++)
-            residual(i) = y[i] - mu[i];
-
-        // perform the cholesky decomposition of C
-        Eigen::LLT<Eigen::MatrixXd> cholesky = C.llt();
-        // get the lower triangular matrix L
-        MatrixXd L = cholesky.matrixL();
-
-        double logDeterminant = 0.;
-        for(size_t i=0; i<y.size(); i++)
-            logDeterminant += 2.*log(L(i,i));
-
-        VectorXd solution = cholesky.solve(residual);
-
-        // y*solution
-        double exponent = 0.;
-        for(size_t i=0; i<y.size(); i++)
-            exponent += residual(i)*solution(i);
+            residual(i) -= systematics[i];
 
-        logL = -0.5*y.size()*log(2*M_PI)
-                - 0.5*logDeterminant - 0.5*exponent;
+        // residual^T C^-1 residual, with the factorization of C from calculate_C
+        double chi2;
+        if(kernel == Kernel::celerite || kernel == Kernel::tapered)
+        {
+            VectorXd whitened(y.size());
+            whiten(residual.data(), whitened.data());
+            chi2 = whitened.squaredNorm();
+        }
+        else
+        {
+            chi2 = quadratic_C(residual);
+            if(kernel == Kernel::inducing)
+                report_inducing(residual);
+        }
 
+        logL = - halflog2pi*data.N - 0.5*C_logdet - 0.5*chi2;
     } 
     else
     {
@@ -457,24 +999,21 @@ double RVmodel::log_likelihood() const
         //  }
 
         // The following code calculates the log likelihood 
-        // in the case of a Gaussian likelihood
-        double var, jit;
-        for(size_t i=0; i<y.size(); i++)
-        {
-            if(multi_instrument)
-            {
-                jit = jitters[obsi[i]-1];
-                var = sig[i]*sig[i] + jit*jit;
-            }
-            else
-                var = sig[i]*sig[i] + extra_sigma*extra_sigma;
-
-            logL += - halflog2pi - 0.5*log(var)
-                    - 0.5*(pow(y[i] - mu[i], 2)/var);
-        }
-
+        // in the case of a Gaussian likelihood, from the sums of the
+        // residuals in each group of points with the same systematics
+        double chi2 = sums_chi2(background, offsets, fiber_offset, slope);
+        logL = - halflog2pi*data.N - 0.5*sum_log_var - 0.5*chi2;
     }
 
+    // the factorization fails if the covariance matrix is not positive
+    // definite (in mixed precision, also found when a solve switches the
+    // factor to double precision)
+    bool factored = C_ok;
+    if(GP && kernel == Kernel::quasi_periodic)
+        factored = factored && (block_tolerance > 0. ? C_blocks.ok() : C_cholesky.ok());
+    if(GP && !factored)
+        logL = -std::numeric_limits<double>::max();
+
     #if TIMING
     auto end = std::chrono::high_resolution_clock::now();
     cout << "Likelihood took " << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count()*1E-6 << " ms" << std::endl;
@@ -489,10 +1028,75 @@ double RVmodel::log_likelihood() const
 
 void RVmodel::print(std::ostream& out) const
 {
+    // the number of planets of each sample, for the estimates while running
+    if (status_interval > 0.)
+    {
+        static std::once_flag started;
+        std::call_once(started, [this]{ status::monitor().start(status_interval); });
+        status::monitor().add_sample(planets.get_components().size());
+    }
+
     // output precision
     out.setf(ios::fixed,ios::floatfield);
     out.precision(8);
 
+    // integrated out systematics are drawn from their conditional posterior
+    double background = this->background, fiber_offset = this->fiber_offset;
+    double slope = this->slope;
+    vector<double> offsets = this->offsets;
+    if(marginalize_systematics)
+    {
+        VectorXd mean;
+        MatrixXd L;
+        fit_systematics(mean, L);
+        VectorXd z = Map<const VectorXd>(linear_z.data(), linear_z.size());
+        VectorXd theta = mean + L.transpose().triangularView<Upper>().solve(z);
+        unpack_systematics(theta, background, offsets, fiber_offset, slope);
+    }
+
+    if (binary_samples)
+    {
+        // the same values, in the same order, to sample.bin
+        vector<double> record;
+        if (multi_instrument)
+            record.insert(record.end(), jitters.begin(), jitters.end());
+        else
+            record.push_back(extra_sigma);
+        if(trend)
+            record.push_back(slope);
+        if (obs_after_HARPS_fibers)
+            record.push_back(fiber_offset);
+        if (multi_instrument)
+            record.insert(record.end(), offsets.begin(), offsets.end());
+        if(GP)
+            record.insert(record.end(), {eta1, eta2, eta3, eta4});
+
+        // as RJObject::print, with the parameters of the planets that are
+        // off as zeros
+        const auto& components = planets.get_components();
+        int max_num = planets.get_max_num_components();
+        record.push_back(planets.get_num_dimensions());
+        record.push_back(max_num);
+        planets.get_conditional_prior().print(record);
+        record.push_back(components.size());
+        for (int j=0; j<planets.get_num_dimensions(); j++)
+        {
+            for (size_t i=0; i<components.size(); i++)
+                record.push_back(components[i][j]);
+            record.insert(record.end(), max_num - components.size(), 0.);
+        }
+
+        record.push_back(staleness);
+        record.push_back(background);
+
+        static std::once_flag opened;
+        std::call_once(opened, [&]{
+            samples::writer().open("sample.bin", description(), record.size());
+        });
+        samples::writer().write(record);
+        return;
+    }
+
     if (multi_instrument)
     {
         for(int j=0; j<jitters.size(); j++)
@@ -564,8 +1168,11 @@ string RVmodel::description() const
 
 
 void RVmodel::save_setup() {
+    // with binary_samples, sample.txt would only get empty lines (see samples.h)
+    samples::discard_text("sample.txt", binary_samples);
+
     // save the options of the current model in a INI file
-    auto data = Data::get_instance();
+    const Data& data = Data::get_instance();
 	std::fstream fout("kima_model_setup.txt", std::ios::out);
     fout << std::boolalpha;
 
@@ -580,6 +1187,7 @@ void RVmodel::save_setup() {
     fout << "hyperpriors: " << hyperpriors << endl;
     fout << "trend: " << trend << endl;
     fout << "multi_instrument: " << multi_instrument << endl;
+    fout << "binary_samples: " << binary_samples << endl;
     fout << endl;
     fout << "file: " << data.datafile << endl;
     fout << "units: " << data.dataunits << endl;
@@ -591,6 +1199,23 @@ void RVmodel::save_setup() {
         fout << f << ",";
     fout << endl;
 
+    fout << "append: ";
+    for (auto& a: data.appended)
+        fout << a.filename << ",";
+    fout << endl;
+    fout << "append_units: ";
+    for (auto& a: data.appended)
+        fout << a.units << ",";
+    fout << endl;
+    fout << "append_skip: ";
+    for (auto& a: data.appended)
+        fout << a.skip << ",";
+    fout << endl;
+    fout << "append_instrument: ";
+    for (auto& a: data.appended)
+        fout << a.instrument << ",";
+    fout << endl;
+
     fout << endl;
 
     fout << "[priors.general]" << endl;
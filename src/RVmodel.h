@@ -6,6 +6,14 @@
 #include "RJObject/RJObject.h"
 #include "RNG.h"
 #include "Data.h"
+#include "kepler.h"
+#include "Residuals.h"
+#include "celerite.h"
+#include "cholesky.h"
+#include "tapered.h"
+#include "inducing.h"
+#include "samples.h"
+#include "status.h"
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <Eigen/Cholesky>
@@ -26,11 +34,73 @@ extern const bool multi_instrument;
 
 class RVmodel
 {
+    public:
+        // The covariance function of the GP
+        enum class Kernel
+        {
+            // the quasi-periodic kernel, with a dense covariance matrix,
+            // O(N^3) operations per evaluation of the likelihood
+            quasi_periodic,
+            // its approximation by a sum of celerite terms, with the same
+            // hyperparameters (see celerite::quasi_periodic), O(N)
+            celerite,
+            // the quasi-periodic kernel tapered to zero for time lags beyond
+            // taper_length*eta2, with a sparse covariance matrix (see tapered.h)
+            tapered,
+            // its low-rank approximation with inducing_points inducing
+            // points (see inducing.h), O(N M^2)
+            inducing
+        };
+
     private:
         // Fix the number of planets? (by default, yes)
         bool fix {true};
         // Maximum number of planets
         int npmax {1};
+        // Tolerated error in the Keplerian signal, as a fraction of the
+        // smallest RV uncertainty. Orbits with low eccentricity are evaluated
+        // with a truncated series when its error is below this (0 disables it)
+        double kepler_tolerance {1e-4};
+        // How to solve Kepler's equation: by iteration (the default), or by
+        // interpolation in a precomputed table (kepler::Solver::table)
+        kepler::Solver kepler_solver {kepler::Solver::iterative};
+        // Precision of the residuals y - mu: compensated double (the default)
+        // or single, for very large datasets (Residuals::Precision::single)
+        Residuals::Precision mu_precision {Residuals::Precision::compensated};
+        // Integrate out the parameters that enter the model linearly (the
+        // systemic velocity, instrument offsets, fiber offset and slope)?
+        // Their priors must then be Uniform (taken as flat) or Gaussian
+        bool marginalize_systematics {false};
+        // The GP kernel (if GP is true), and the number of harmonics of
+        // eta3 in the celerite kernel
+        Kernel kernel {Kernel::quasi_periodic};
+        int celerite_harmonics {2};
+        // The cutoff of the tapered kernel, in units of eta2
+        double taper_length {5.};
+        // The number of inducing points of the inducing kernel, and the
+        // number of data points on which its log-likelihood is compared
+        // with the exact one, once, at the start (0 to skip this)
+        size_t inducing_points {500};
+        size_t inducing_check {1000};
+        // Threads for the Cholesky factorization of the GP covariance matrix
+        // when it has at least cholesky_threshold rows (see cholesky.h)
+        unsigned cholesky_threads {1};
+        size_t cholesky_threshold {2000};
+        // Factorize it in double precision (the default) or in single
+        // precision with iterative refinement (cholesky::Precision::mixed)
+        cholesky::Precision cholesky_precision {cholesky::Precision::full};
+        // With the quasi-periodic kernel, split C into independent blocks
+        // (observing seasons) at gaps in the data across which the kernel
+        // is below block_tolerance*eta1^2, and factorize the blocks
+        // separately (and in parallel, with cholesky_threads). 0 disables it
+        double block_tolerance {0.};
+        // Write the samples to sample.bin (see samples.h) instead of as
+        // text to sample.txt, from a background thread
+        bool binary_samples {false};
+        // Write estimates of the evidence, the information, the effective
+        // sample size and the posterior of Np to kima_status.txt every
+        // status_interval seconds while running (see status.h). 0 disables it
+        double status_interval {0.};
 
         DNest4::RJObject<RVConditionalPrior> planets =
             DNest4::RJObject<RVConditionalPrior>(5, npmax, fix, RVConditionalPrior());
@@ -52,10 +122,44 @@ class RVmodel
         double log_eta1, log_eta2, log_eta3, log_eta4, log_eta5;
         double a,b,c,P;
 
-        // The signal
-        std::vector<long double> mu = // the RV model
-                            std::vector<long double>(Data::get_instance().N());
-        void calculate_mu();
+        // The residuals of the data after subtracting the planets, y - mu.
+        // The systematics are not included, they enter in log_likelihood
+        Residuals residuals;
+        void calculate_mu(bool from_scratch=false);
+        void calculate_systematics(std::vector<double>& model) const;
+
+        // Weighted sums of the residuals, for each instrument before and
+        // after the change in HARPS fibers, from which the white-noise
+        // likelihood follows for any values of the systematics
+        struct residual_sums
+        {
+            double w {0.};                 // sum of the weights 1/var
+            double r {0.}, t {0.};         // weighted means of the residuals and t - t_middle
+            double rr {0.}, rt {0.}, tt {0.}; // weighted sums of the centred products
+        };
+        std::vector<residual_sums> sums;
+        double sum_log_var;
+        void calculate_sums();
+        double sums_chi2(double background, const std::vector<double>& offsets,
+                         double fiber_offset, double slope) const;
+
+        // For the marginalization of the systematics: their priors, as a
+        // mean and precision (0 for flat priors) and the sum of the log
+        // normalizations, and the standard normal numbers used to draw them
+        // from their conditional posterior in print
+        std::vector<double> linear_mean, linear_precision;
+        double linear_log_norm;
+        std::vector<double> linear_z;
+        void setup_linear_priors();
+        double fit_systematics(Eigen::VectorXd& mean, Eigen::MatrixXd& L) const;
+        void unpack_systematics(const Eigen::VectorXd& theta, double& background,
+                                std::vector<double>& offsets,
+                                double& fiber_offset, double& slope) const;
+
+        // The signal of each planet, and the parameters it was calculated
+        // with, so that only new or perturbed planets need to be evaluated
+        std::vector< std::vector<double> > planet_pars;
+        std::vector< std::vector<double> > planet_mu;
 
         // eccentric and true anomalies
         double ecc_anomaly(double time, double prd, double ecc, double peri_pass);
@@ -63,9 +167,42 @@ class RVmodel
         double keplerstart3(double e, double M);
         double true_anomaly(double time, double prd, double ecc, double peri_pass);
 
-        // The covariance matrix for the data
-        Eigen::MatrixXd C {Data::get_instance().N(), Data::get_instance().N()};
+        // The covariance matrix for the data, with the quasi-periodic
+        // kernel, or its factorization, with the other kernels
+        Eigen::MatrixXd C = GP && kernel == Kernel::quasi_periodic ?
+            Eigen::MatrixXd(Data::get_instance().N(), Data::get_instance().N()) :
+            Eigen::MatrixXd();
+        celerite::Solver celerite_gp;
+        tapered::Solver tapered_gp;
+        inducing::Solver inducing_gp;
         void calculate_C();
+        // z = L^-1 y with the celerite or tapered factorization C = L L^T
+        void whiten(const double* y, double* z) const;
+        // B = C^-1 B and r^T C^-1 r with the quasi-periodic kernel (dense
+        // or in blocks) and the inducing kernel
+        void solve_C(Eigen::Ref<Eigen::MatrixXd> B) const;
+        double quadratic_C(const Eigen::VectorXd& r) const;
+        // print the error of the inducing kernel's log-likelihood for the
+        // residuals r (on the first call only)
+        void report_inducing(const Eigen::VectorXd& r) const;
+        // The Cholesky factorization of C and its log-determinant, updated
+        // in calculate_C, so that proposals that don't change C only need
+        // a triangular solve
+        cholesky::Factor C_cholesky;
+        double C_logdet {0.};
+        bool C_ok {true};
+        // the hyperparameters C was calculated with, and sin and cos of
+        // pi t/eta3 at each time, so that proposals recalculate only the
+        // parts of C they change
+        std::vector<double> C_eta;
+        std::vector<double> C_sin, C_cos;
+        // the block of each point, the factorization of the blocks of C,
+        // and the range of eta2 in which the blocks stay the same
+        std::vector<int> C_block;
+        cholesky::BlockFactor C_blocks;
+        double C_eta2_min {0.}, C_eta2_max {0.};
+        // update the blocks for this eta2; returns true if they changed
+        bool update_blocks(double eta2);
 
         unsigned int staleness;
 
@@ -83,6 +220,10 @@ class RVmodel
         // Likelihood function
         double log_likelihood() const;
 
+        // Largest error of the residuals, against a recalculation in long
+        // double (to check the precision of the updates), in m/s
+        double check_residuals() const;
+
         // Print to stream
         void print(std::ostream& out) const;
 
@@ -0,0 +1,145 @@
+#ifndef DNest4_Residuals
+#define DNest4_Residuals
+
+#include <vector>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+/*
+    Residuals of the RV model, y - mu, kept up to date as the signals of the
+    model components are added and subtracted.
+
+    In the default (compensated) precision the residuals are doubles with a
+    Kahan compensation term, so that a sequence of updates loses no more
+    accuracy than a single sum. The compensation is below half an ulp of
+    the residual, and is kept as a float, for 12 bytes per point instead of
+    the 16 of a long double. In single precision the residuals are floats,
+    with a quarter of the memory, for very large datasets. The residuals
+    still contain the systemic velocity and the instrument offsets, so the
+    floats store them relative to the mean RV of each instrument, kept in
+    double; the rounding is then relative to the scatter of the RVs and
+    the planet signals, not to the absolute RVs.
+*/
+class Residuals
+{
+    public:
+        enum class Precision { compensated, single };
+
+        Residuals() {}
+
+        // set the residuals to y - model; `instrument` (of each point, from
+        // 0) sets the groups of the references in single precision
+        void reset(const double* y, const std::vector<double>& model,
+                   Precision precision=Precision::compensated,
+                   const int* instrument=nullptr)
+        {
+            this->precision = precision;
+            size_t N = model.size();
+            if (precision == Precision::single)
+            {
+                this->instrument = instrument;
+                set_references(y, N);
+                rf.resize(N);
+                for (size_t i=0; i<N; i++)
+                    rf[i] = static_cast<float>((y[i] - reference[group(i)]) - model[i]);
+                r.clear(); r.shrink_to_fit();
+                c.clear(); c.shrink_to_fit();
+            }
+            else
+            {
+                r.resize(N);
+                c.assign(N, 0.f);
+                for (size_t i=0; i<N; i++)
+                    r[i] = y[i] - model[i];
+                rf.clear(); rf.shrink_to_fit();
+            }
+        }
+
+        // add the signal x to the model (subtract it from the residuals)
+        void add(const std::vector<double>& x) { update(x, -1.); }
+
+        // subtract the signal x from the model
+        void subtract(const std::vector<double>& x) { update(x, 1.); }
+
+        // copy the residuals to out (of size())
+        void copy_to(double* out) const
+        {
+            if (precision == Precision::single)
+            {
+                for (size_t i=0; i<rf.size(); i++)
+                    out[i] = rf[i] + reference[group(i)];
+            }
+            else
+            {
+                for (size_t i=0; i<r.size(); i++)
+                    out[i] = r[i] - c[i];
+            }
+        }
+
+        size_t size() const
+        {
+            return precision == Precision::single ? rf.size() : r.size();
+        }
+
+        // the largest residual as stored (relative to the references in
+        // single precision), to which the rounding errors are relative
+        double largest() const
+        {
+            double largest = 0.;
+            for (double ri : r)
+                largest = std::max(largest, std::abs(ri));
+            for (float ri : rf)
+                largest = std::max(largest, (double) std::abs(ri));
+            return largest;
+        }
+
+    private:
+        Precision precision {Precision::compensated};
+        std::vector<double> r;
+        std::vector<float> c, rf;
+        // in single precision, the mean RV of each instrument
+        const int* instrument {nullptr};
+        std::vector<double> reference;
+
+        size_t group(size_t i) const { return instrument ? instrument[i] : 0; }
+
+        void set_references(const double* y, size_t N)
+        {
+            size_t groups = 1;
+            for (size_t i=0; i<N; i++)
+                groups = std::max(groups, group(i) + 1);
+            reference.assign(groups, 0.);
+            std::vector<size_t> count(groups, 0);
+            for (size_t i=0; i<N; i++)
+            {
+                reference[group(i)] += y[i];
+                count[group(i)]++;
+            }
+            for (size_t k=0; k<groups; k++)
+                if (count[k] > 0)
+                    reference[k] /= count[k];
+        }
+
+        void update(const std::vector<double>& x, double sign)
+        {
+            if (precision == Precision::single)
+            {
+                for (size_t i=0; i<rf.size(); i++)
+                    rf[i] = static_cast<float>(rf[i] + sign*x[i]);
+            }
+            else
+            {
+                // Kahan summation, element by element
+                for (size_t i=0; i<r.size(); i++)
+                {
+                    double yi = sign*x[i] - c[i];
+                    double ti = r[i] + yi;
+                    c[i] = static_cast<float>((ti - r[i]) - yi);
+                    r[i] = ti;
+                }
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "celerite.h"
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+namespace celerite
+{
+
+void Terms::add(double a, double b, double c, double d)
+{
+    this->a.push_back(a);
+    this->b.push_back(b);
+    this->c.push_back(c);
+    this->d.push_back(d);
+}
+
+
+void quasi_periodic(double eta1, double eta2, double eta3, double eta4,
+                    int harmonics, Terms& terms)
+{
+    terms.clear();
+
+    // exp(-2 sin^2(x/2)/eta4^2) = exp(-u (1 - cos x))
+    //     = exp(-u) [I_0(u) + 2 sum_n I_n(u) cos(n x)]
+    // and the weights exp(-u) I_n(u) = 1/pi int_0^pi exp(-u(1 - cos x)) cos(nx) dx
+    // are integrated with the trapezoidal rule, which converges exponentially
+    // for periodic functions, with enough points to resolve the peak at x=0
+    double u = 1. / (eta4*eta4);
+    int M = 16 + int(8*std::sqrt(u));
+    std::vector<double> weights(harmonics + 1, 0.);
+    for (int k=0; k<=M; k++)
+    {
+        double x = M_PI * k / M;
+        double f = std::exp(-u*(1. - std::cos(x))) / M;
+        if (k == 0 || k == M) f *= 0.5;
+        for (int n=0; n<=harmonics; n++)
+            weights[n] += (n == 0 ? 1. : 2.) * f * std::cos(n*x);
+    }
+
+    double norm = 0.;
+    for (auto w : weights)
+        norm += w;
+
+    double amp = eta1*eta1 / norm;
+    for (int n=0; n<=harmonics; n++)
+        terms.add(amp*weights[n], 0., 1./eta2, 2.*M_PI*n/eta3);
+}
+
+
+void Solver::set_times(const double* t, size_t N)
+{
+    order.resize(N);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [t](size_t i, size_t j){ return t[i] < t[j]; });
+
+    this->t.resize(N);
+    for (size_t n=0; n<N; n++)
+        this->t[n] = t[order[n]] - t[order[0]];
+}
+
+
+bool Solver::factor(const Terms& terms, const double* diag)
+{
+    size_t N = order.size();
+
+    J = 0;
+    for (size_t j=0; j<terms.size(); j++)
+        J += terms.d[j] == 0. ? 1 : 2;
+
+    U.resize(N*J);
+    V.resize(N*J);
+    P.resize(N*J);
+    W.resize(N*J);
+    D.resize(N);
+
+    double sum_a = 0.;
+    for (size_t j=0; j<terms.size(); j++)
+        sum_a += terms.a[j];
+
+    // the semiseparable representation, k(t_n - t_m) = U_n . V_m times the
+    // products of P between m and n
+    for (size_t n=0; n<N; n++)
+    {
+        double dt = n == 0 ? 0. : t[n] - t[n-1];
+        double* Un = &U[n*J];
+        double* Vn = &V[n*J];
+        double* Pn = &P[n*J];
+        size_t k = 0;
+        for (size_t j=0; j<terms.size(); j++)
+        {
+            double a = terms.a[j], b = terms.b[j];
+            double p = std::exp(-terms.c[j] * dt);
+            if (terms.d[j] == 0.)
+            {
+                Un[k] = a; Vn[k] = 1.; Pn[k] = p;
+                k++;
+            }
+            else
+            {
+                double c = std::cos(terms.d[j] * t[n]);
+                double s = std::sin(terms.d[j] * t[n]);
+                Un[k] = a*c + b*s; Vn[k] = c; Pn[k] = p;
+                Un[k+1] = a*s - b*c; Vn[k+1] = s; Pn[k+1] = p;
+                k += 2;
+            }
+        }
+    }
+
+    // the factorization, with S the J x J running sum of W W^T D
+    std::vector<double> S(J*J, 0.), tmp(J);
+    log_det = 0.;
+    for (size_t n=0; n<N; n++)
+    {
+        const double* Un = &U[n*J];
+        const double* Vn = &V[n*J];
+        const double* Pn = &P[n*J];
+        double* Wn = &W[n*J];
+
+        if (n > 0)
+        {
+            const double* Wp = &W[(n-1)*J];
+            for (size_t k=0; k<J; k++)
+                for (size_t l=0; l<J; l++)
+                    S[k*J+l] = Pn[k] * Pn[l] * (S[k*J+l] + D[n-1]*Wp[k]*Wp[l]);
+        }
+
+        double Dn = diag[order[n]] + sum_a;
+        for (size_t k=0; k<J; k++)
+        {
+            tmp[k] = 0.;
+            for (size_t l=0; l<J; l++)
+                tmp[k] += S[k*J+l] * Un[l];
+            Dn -= Un[k] * tmp[k];
+        }
+
+        if (!(Dn > 0.))
+            return false;
+
+        D[n] = Dn;
+        log_det += std::log(Dn);
+        for (size_t k=0; k<J; k++)
+            Wn[k] = (Vn[k] - tmp[k]) / Dn;
+    }
+
+    return true;
+}
+
+
+void Solver::whiten(const double* y, double* z) const
+{
+    size_t N = order.size();
+    std::vector<double> F(J, 0.);
+    double previous = 0.;
+
+    // forward substitution with L, then scaling by D^-1/2
+    for (size_t n=0; n<N; n++)
+    {
+        const double* Un = &U[n*J];
+        const double* Pn = &P[n*J];
+        double zn = y[order[n]];
+        if (n > 0)
+        {
+            const double* Wp = &W[(n-1)*J];
+            for (size_t k=0; k<J; k++)
+            {
+                F[k] = Pn[k] * (F[k] + Wp[k]*previous);
+                zn -= Un[k] * F[k];
+            }
+        }
+        previous = zn;
+        z[n] = zn / std::sqrt(D[n]);
+    }
+}
+
+}
@@ -0,0 +1,73 @@
+#ifndef DNest4_celerite
+#define DNest4_celerite
+
+#include <vector>
+#include <cstddef>
+
+/*
+    Gaussian processes with semiseparable covariance matrices, following
+    Foreman-Mackey et al. (2017, AJ 154, 220).
+    The kernel is a sum of terms
+        k(tau) = sum_j exp(-c_j tau) [a_j cos(d_j tau) + b_j sin(d_j tau)]
+    with tau = |t_n - t_m|, and the covariance matrix (plus a diagonal) can
+    be factorized, and linear systems solved, in O(N J^2) operations and
+    O(N J) memory, where J is the number of terms (two for each term with
+    d_j != 0), instead of the O(N^3) and O(N^2) of a dense matrix.
+*/
+namespace celerite
+{
+    // the coefficients of the terms in the kernel
+    struct Terms
+    {
+        std::vector<double> a, b, c, d;
+
+        void clear() { a.clear(); b.clear(); c.clear(); d.clear(); }
+        void add(double a, double b, double c, double d);
+        size_t size() const { return a.size(); }
+    };
+
+    // An approximation to the quasi-periodic kernel of RVmodel,
+    //   eta1^2 exp(-0.5 tau^2/eta2^2 - 2 sin^2(pi tau/eta3)/eta4^2)
+    // The periodic part is expanded in harmonics of 1/eta3, with weights
+    // exp(-u) I_n(u), u = 1/eta4^2, of which the first `harmonics` are kept
+    // (and rescaled so that k(0) = eta1^2), and the squared exponential
+    // envelope is replaced by exp(-tau/eta2).
+    void quasi_periodic(double eta1, double eta2, double eta3, double eta4,
+                        int harmonics, Terms& terms);
+
+    // Cholesky factorization K = L D L^T of the covariance matrix
+    // K = diag + k(t_n - t_m), with L unit lower triangular and semiseparable
+    class Solver
+    {
+        public:
+            Solver() {}
+
+            // set the times of the observations, in any order
+            // (the data is sorted internally)
+            void set_times(const double* t, size_t N);
+            size_t size() const { return order.size(); }
+
+            // factorize the covariance matrix for these terms and the
+            // diagonal `diag` (in the order of the times given to set_times).
+            // Returns false if it is not positive definite
+            bool factor(const Terms& terms, const double* diag);
+
+            // log of the determinant of K
+            double log_determinant() const { return log_det; }
+
+            // z = D^-1/2 L^-1 y, so that y^T K^-1 y = z^T z.
+            // The elements of z are in time order, which doesn't matter for
+            // products of whitened vectors
+            void whiten(const double* y, double* z) const;
+
+        private:
+            std::vector<size_t> order; // argsort of the times
+            std::vector<double> t;     // sorted times, from the first one
+            size_t J {0};              // number of columns of U, V and W
+            std::vector<double> U, V, W, P; // N x J, row major
+            std::vector<double> D;
+            double log_det {0.};
+    };
+}
+
+#endif
@@ -0,0 +1,626 @@
+#include "cholesky.h"
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <random>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+using namespace Eigen;
+
+namespace cholesky
+{
+
+namespace
+{
+    /*
+        Flush subnormal numbers to zero in this thread, while in scope.
+        In single precision, the products of the small elements of the
+        covariance matrix (the kernel decays exponentially) are often
+        subnormal, and arithmetic with them is very slow on x86.
+    */
+    class FlushSubnormals
+    {
+        public:
+            FlushSubnormals()
+            {
+                #if defined(__SSE__)
+                mxcsr = _mm_getcsr();
+                // flush-to-zero and denormals-are-zero
+                _mm_setcsr(mxcsr | 0x8040);
+                #endif
+            }
+            ~FlushSubnormals()
+            {
+                #if defined(__SSE__)
+                _mm_setcsr(mxcsr);
+                #endif
+            }
+        private:
+            unsigned int mxcsr {0};
+    };
+
+    // size of the tiles in the blocked algorithms
+    const Index TILE = 256;
+
+    // iterative refinement stops when the correction is below this,
+    // relative to the solution, or after this many steps
+    const double REFINEMENT_TOLERANCE = 1e-12;
+    const int MAX_REFINEMENTS = 10;
+
+    // largest estimated error of the log-determinant from the single
+    // precision factor (half of it enters the log-likelihood), and the
+    // number of random vectors of the estimate
+    const double LOGDET_TOLERANCE = 1e-2;
+    const int LOGDET_PROBES = 4;
+
+    /*
+        A fixed set of worker threads that run the iterations of parallel
+        loops. Each loop is a job in a queue, whose iterations are claimed
+        with an atomic counter by the workers and by the thread that
+        submitted it, so loops from different sampler threads share the
+        workers instead of each starting their own.
+    */
+    class ThreadPool
+    {
+        public:
+            explicit ThreadPool(unsigned workers)
+            {
+                for (unsigned i=0; i<workers; i++)
+                    threads.emplace_back([this]{ work(); });
+            }
+
+            ~ThreadPool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stop = true;
+                }
+                wake.notify_all();
+                for (auto& t : threads)
+                    t.join();
+            }
+
+            // call f(i) for i = 0, ..., n-1, and return when all are done
+            void parallel_for(size_t n, const std::function<void(size_t)>& f)
+            {
+                if (n == 0) return;
+                auto job = std::make_shared<Job>(n, f);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    jobs.push_back(job);
+                }
+                wake.notify_all();
+
+                run(*job);
+
+                std::unique_lock<std::mutex> lock(mutex);
+                finished.wait(lock, [&]{ return job->done == n; });
+                auto it = std::find(jobs.begin(), jobs.end(), job);
+                if (it != jobs.end())
+                    jobs.erase(it);
+            }
+
+        private:
+            struct Job
+            {
+                Job(size_t n, const std::function<void(size_t)>& f) : n(n), f(f) {}
+                size_t n;
+                const std::function<void(size_t)>& f;
+                std::atomic<size_t> next {0};
+                std::atomic<size_t> done {0};
+            };
+
+            std::vector<std::thread> threads;
+            std::deque< std::shared_ptr<Job> > jobs;
+            std::mutex mutex;
+            std::condition_variable wake, finished;
+            bool stop {false};
+
+            // claim and run iterations of the job until there are none left
+            void run(Job& job)
+            {
+                size_t i;
+                while ((i = job.next++) < job.n)
+                {
+                    job.f(i);
+                    if (++job.done == job.n)
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        finished.notify_all();
+                    }
+                }
+            }
+
+            void work()
+            {
+                // the workers only run the factorizations and solves
+                FlushSubnormals flush;
+                while (true)
+                {
+                    std::shared_ptr<Job> job;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        wake.wait(lock, [&]{ return stop || !jobs.empty(); });
+                        if (stop) return;
+                        job = jobs.front();
+                        // no iterations left to claim, so take it off the queue
+                        if (job->next >= job->n)
+                        {
+                            jobs.pop_front();
+                            continue;
+                        }
+                    }
+                    run(*job);
+                }
+            }
+    };
+
+    // the pool is created, with threads - 1 workers, the first time a
+    // blocked factorization is requested
+    ThreadPool& pool(unsigned threads)
+    {
+        static ThreadPool p(threads > 1 ? threads - 1 : 0);
+        return p;
+    }
+
+    Index ntiles(Index N) { return (N + TILE - 1) / TILE; }
+    Index tile_size(Index N, Index k) { return std::min(TILE, N - k*TILE); }
+
+    // right-looking blocked algorithm, on the lower triangle of L.
+    // For each column of tiles k: factorize the diagonal tile, solve for the
+    // tiles below it, and update the trailing tiles (i, j), k < j <= i,
+    // the last two steps in parallel over the tiles
+    template <typename Matrix>
+    bool factor_blocked(Matrix& L, ThreadPool& workers)
+    {
+        Index N = L.rows();
+        Index nt = ntiles(N);
+
+        for (Index k=0; k<nt; k++)
+        {
+            Index k0 = k*TILE, kn = tile_size(N, k);
+
+            LLT<Matrix> diag(L.block(k0, k0, kn, kn));
+            if (diag.info() != Eigen::Success)
+                return false;
+            L.block(k0, k0, kn, kn) = diag.matrixL();
+
+            Index below = nt - k - 1;
+            if (below == 0)
+                break;
+
+            // L_ik = A_ik L_kk^-T
+            workers.parallel_for(below, [&](size_t t)
+            {
+                Index i0 = (k + 1 + t)*TILE, in = tile_size(N, k + 1 + t);
+                typename Matrix::BlockXpr Lik = L.block(i0, k0, in, kn);
+                L.block(k0, k0, kn, kn).template triangularView<Lower>().transpose()
+                    .template solveInPlace<OnTheRight>(Lik);
+            });
+
+            // tiles (i, j) of the trailing matrix, with k < j <= i
+            std::vector< std::pair<Index, Index> > tiles;
+            for (Index j=k+1; j<nt; j++)
+                for (Index i=j; i<nt; i++)
+                    tiles.push_back(std::make_pair(i, j));
+
+            workers.parallel_for(tiles.size(), [&](size_t t)
+            {
+                Index i = tiles[t].first, j = tiles[t].second;
+                Index i0 = i*TILE, in = tile_size(N, i);
+                Index j0 = j*TILE, jn = tile_size(N, j);
+                L.block(i0, j0, in, jn).noalias() -=
+                    L.block(i0, k0, in, kn) * L.block(j0, k0, jn, kn).transpose();
+            });
+        }
+
+        L.template triangularView<StrictlyUpper>().setZero();
+        return true;
+    }
+
+    // blocked forward substitution, B = L^-1 B: solve with each diagonal
+    // tile, then subtract its contribution from the rows below, in parallel
+    template <typename Matrix, typename Rhs>
+    void solve_lower_blocked(const Matrix& L, Rhs& B, ThreadPool& workers)
+    {
+        Index N = L.rows();
+        Index nt = ntiles(N);
+
+        for (Index k=0; k<nt; k++)
+        {
+            Index k0 = k*TILE, kn = tile_size(N, k);
+            auto Bk = B.middleRows(k0, kn);
+            L.block(k0, k0, kn, kn).template triangularView<Lower>().solveInPlace(Bk);
+
+            Index below = nt - k - 1;
+            if (below == 0)
+                break;
+
+            workers.parallel_for(below, [&](size_t t)
+            {
+                Index i0 = (k + 1 + t)*TILE, in = tile_size(N, k + 1 + t);
+                B.middleRows(i0, in).noalias() -=
+                    L.block(i0, k0, in, kn) * B.middleRows(k0, kn);
+            });
+        }
+    }
+
+    // the same, backward, B = L^-T B
+    template <typename Matrix, typename Rhs>
+    void solve_upper_blocked(const Matrix& L, Rhs& B, ThreadPool& workers)
+    {
+        Index N = L.rows();
+        Index nt = ntiles(N);
+
+        for (Index k=nt-1; k>=0; k--)
+        {
+            Index k0 = k*TILE, kn = tile_size(N, k);
+            auto Bk = B.middleRows(k0, kn);
+            L.block(k0, k0, kn, kn).template triangularView<Lower>().transpose()
+                .solveInPlace(Bk);
+
+            if (k == 0)
+                break;
+
+            workers.parallel_for(k, [&](size_t i)
+            {
+                Index i0 = i*TILE, in = tile_size(N, i);
+                B.middleRows(i0, in).noalias() -=
+                    L.block(k0, i0, kn, in).transpose() * B.middleRows(k0, kn);
+            });
+        }
+    }
+}
+
+
+bool Factor::compute(const MatrixXd& A, unsigned threads, size_t threshold,
+                     Precision precision)
+{
+    Index N = A.rows();
+    this->threads = threads;
+    this->precision = precision;
+    blocked = threads > 1 && size_t(N) >= threshold;
+
+    llt = LLT<MatrixXd>();
+    L.resize(0, 0);
+    L_single.resize(0, 0);
+
+    if (precision == Precision::mixed)
+    {
+        if (factor_single(A))
+            return factored = true;
+        // fall back to double precision
+        this->precision = Precision::full;
+    }
+
+    if (!factor_full(A))
+        return false;
+    log_det = 0.;
+    for (Index i=0; i<N; i++)
+        log_det += 2.*std::log(blocked ? L(i,i) : llt.matrixLLT()(i,i));
+    return true;
+}
+
+
+bool Factor::factor_full(const MatrixXd& A) const
+{
+    precision = Precision::full;
+    L_single.resize(0, 0);
+    if (blocked)
+    {
+        L = A.triangularView<Lower>();
+        factored = factor_blocked(L, pool(threads));
+    }
+    else
+    {
+        llt.compute(A);
+        factored = llt.info() == Eigen::Success;
+    }
+    return factored;
+}
+
+
+bool Factor::factor_single(const MatrixXd& A)
+{
+    Index N = A.rows();
+    FlushSubnormals flush;
+
+    L_single = A.cast<float>();
+    if (blocked)
+    {
+        if (!factor_blocked(L_single, pool(threads)))
+            return false;
+    }
+    else
+    {
+        // in place
+        LLT< Ref<MatrixXf> > llt_single(L_single);
+        if (llt_single.info() != Eigen::Success)
+            return false;
+    }
+
+    // iterative refinement converges at a rate of about cond(A) times the
+    // float epsilon. The spread of the diagonal of L, squared, is only a
+    // lower bound of cond(A), which rejects the clearly ill-conditioned
+    // matrices early. The others are caught by the solves: a test solve
+    // here, and every solve falls back to double precision if it does not
+    // converge (see solve and quadratic)
+    double dmin = L_single(0,0), dmax = L_single(0,0);
+    log_det = 0.;
+    for (Index i=0; i<N; i++)
+    {
+        double d = L_single(i,i);
+        dmin = std::min(dmin, d);
+        dmax = std::max(dmax, d);
+        log_det += 2.*std::log(d);
+    }
+    if (pow(dmax/dmin, 2) * std::numeric_limits<float>::epsilon() > 1e-3)
+        return false;
+
+    VectorXd x = VectorXd::Ones(N);
+    if (!refine_impl(A, x))
+        return false;
+
+    return log_det_error(A) <= LOGDET_TOLERANCE;
+}
+
+
+// An estimate of the error of log_det, from the single precision factor
+// L, with E = L^-1 A L^-T - I: log det(A) = log_det + log det(I + E), and
+// log det(I + E) is about tr(E), estimated with random vectors z of +-1
+// as the mean of z^T E z = w^T A w - z^T z, with w = L^-T z. Returns the
+// estimate plus twice its standard error
+double Factor::log_det_error(const MatrixXd& A) const
+{
+    Index N = A.rows();
+    std::mt19937 rng(N);
+    std::vector<double> estimates(LOGDET_PROBES);
+    for (int p=0; p<LOGDET_PROBES; p++)
+    {
+        VectorXd z(N);
+        for (Index i=0; i<N; i++)
+            z(i) = (rng() & 1) ? 1. : -1.;
+
+        // w = L^-T z, in double precision, by columns of L
+        VectorXd w = z;
+        for (Index i=N-1; i>=0; i--)
+        {
+            const float* column = &L_single(0, i);
+            double sum = w(i);
+            for (Index k=i+1; k<N; k++)
+                sum -= column[k] * w(k);
+            w(i) = sum / column[i];
+        }
+
+        VectorXd Aw = A.selfadjointView<Lower>() * w;
+        estimates[p] = w.dot(Aw) - z.squaredNorm();
+    }
+
+    double mean = 0., variance = 0.;
+    for (double e : estimates)
+        mean += e / LOGDET_PROBES;
+    for (double e : estimates)
+        variance += (e - mean)*(e - mean) / (LOGDET_PROBES - 1);
+    return std::abs(mean) + 2.*std::sqrt(variance / LOGDET_PROBES);
+}
+
+
+// B = A^-1 B with the float factor, and iterative refinement of the
+// residual in double precision. Returns false if it does not converge
+bool Factor::refine(const MatrixXd& A, Ref<MatrixXd> B) const
+{
+    // matrix-vector products and triangular solves with a vector are much
+    // faster than with a matrix of one column
+    if (B.cols() == 1)
+    {
+        VectorXd b = B.col(0);
+        bool converged = refine_impl(A, b);
+        B.col(0) = b;
+        return converged;
+    }
+    MatrixXd b = B;
+    bool converged = refine_impl(A, b);
+    B = b;
+    return converged;
+}
+
+
+template <typename Rhs>
+bool Factor::refine_impl(const MatrixXd& A, Rhs& B) const
+{
+    Rhs X = B;
+    solve_single(X);
+
+    double previous = std::numeric_limits<double>::infinity();
+    for (int it=0; it<MAX_REFINEMENTS; it++)
+    {
+        Rhs R = B;
+        R.noalias() -= A.selfadjointView<Lower>() * X;
+        solve_single(R);
+        X += R;
+
+        double correction = R.norm();
+        if (correction <= REFINEMENT_TOLERANCE * X.norm())
+        {
+            B = X;
+            return true;
+        }
+        // each step should reduce the error by about cond(A) 1e-7
+        if (correction > 0.5*previous)
+            break;
+        previous = correction;
+    }
+    B = X;
+    return false;
+}
+
+
+template <typename Rhs>
+void Factor::solve_single(Rhs& B) const
+{
+    typedef Matrix<float, Rhs::RowsAtCompileTime, Rhs::ColsAtCompileTime> RhsFloat;
+    FlushSubnormals flush;
+    RhsFloat Bf = B.template cast<float>();
+    if (blocked)
+    {
+        solve_lower_blocked(L_single, Bf, pool(threads));
+        solve_upper_blocked(L_single, Bf, pool(threads));
+    }
+    else
+    {
+        L_single.triangularView<Lower>().solveInPlace(Bf);
+        L_single.triangularView<Lower>().transpose().solveInPlace(Bf);
+    }
+    B = Bf.template cast<double>();
+}
+
+
+template <typename Rhs>
+void Factor::solve_lower(Rhs& B) const
+{
+    if (blocked)
+        solve_lower_blocked(L, B, pool(threads));
+    else
+        llt.matrixL().solveInPlace(B);
+}
+
+
+void Factor::solve(const MatrixXd& A, Ref<MatrixXd> B) const
+{
+    if (precision == Precision::mixed)
+    {
+        MatrixXd X = B;
+        if (refine(A, X))
+        {
+            B = X;
+            return;
+        }
+        // refinement stalled for this B, factorize in double precision
+        factor_full(A);
+    }
+
+    MatrixXd X = B;
+    solve_lower(X);
+    if (blocked)
+        solve_upper_blocked(L, X, pool(threads));
+    else
+        llt.matrixU().solveInPlace(X);
+    B = X;
+}
+
+
+double Factor::quadratic(const MatrixXd& A, const VectorXd& r) const
+{
+    VectorXd x = r;
+    if (precision == Precision::mixed)
+    {
+        if (refine_impl(A, x))
+            return r.dot(x);
+        // refinement stalled for this r, factorize in double precision
+        factor_full(A);
+        x = r;
+    }
+    solve_lower(x);
+    return x.squaredNorm();
+}
+
+
+
+void BlockFactor::set_blocks(const std::vector<int>& block)
+{
+    index.clear();
+    for (size_t i=0; i<block.size(); i++)
+    {
+        if (size_t(block[i]) >= index.size())
+            index.resize(block[i] + 1);
+        index[block[i]].push_back(i);
+    }
+    A.resize(index.size());
+    factors.resize(index.size());
+}
+
+
+bool BlockFactor::compute(const MatrixXd& A, unsigned threads,
+                          size_t threshold, Precision precision)
+{
+    size_t nb = index.size();
+    std::vector<char> ok(nb);
+
+    auto factor = [&](size_t b)
+    {
+        const std::vector<Index>& idx = index[b];
+        Index n = idx.size();
+        MatrixXd& Ab = this->A[b];
+        Ab.resize(n, n);
+        for (Index j=0; j<n; j++)
+            for (Index i=j; i<n; i++)
+                Ab(i, j) = Ab(j, i) = A(idx[i], idx[j]);
+        ok[b] = factors[b].compute(Ab, threads, threshold, precision);
+    };
+
+    if (threads > 1 && nb > 1)
+        pool(threads).parallel_for(nb, factor);
+    else
+        for (size_t b=0; b<nb; b++)
+            factor(b);
+
+    log_det = 0.;
+    for (size_t b=0; b<nb; b++)
+    {
+        if (!ok[b])
+            return false;
+        log_det += factors[b].log_determinant();
+    }
+    return true;
+}
+
+
+bool BlockFactor::ok() const
+{
+    for (const Factor& factor : factors)
+        if (!factor.ok())
+            return false;
+    return true;
+}
+
+
+void BlockFactor::solve(Ref<MatrixXd> B) const
+{
+    for (size_t b=0; b<index.size(); b++)
+    {
+        const std::vector<Index>& idx = index[b];
+        MatrixXd Bb(idx.size(), B.cols());
+        for (size_t i=0; i<idx.size(); i++)
+            Bb.row(i) = B.row(idx[i]);
+        factors[b].solve(A[b], Bb);
+        for (size_t i=0; i<idx.size(); i++)
+            B.row(idx[i]) = Bb.row(i);
+    }
+}
+
+
+double BlockFactor::quadratic(const VectorXd& r) const
+{
+    double q = 0.;
+    for (size_t b=0; b<index.size(); b++)
+    {
+        const std::vector<Index>& idx = index[b];
+        VectorXd rb(idx.size());
+        for (size_t i=0; i<idx.size(); i++)
+            rb(i) = r(idx[i]);
+        q += factors[b].quadratic(A[b], rb);
+    }
+    return q;
+}
+
+}
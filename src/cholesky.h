@@ -0,0 +1,120 @@
+#ifndef DNest4_cholesky
+#define DNest4_cholesky
+
+#include <cstddef>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+
+/*
+    Cholesky factorization of the dense GP covariance matrix.
+    Small matrices use Eigen's LLT, as before. Matrices with at least
+    `threshold` rows are factorized with a blocked, right-looking algorithm
+    whose tile operations run on a pool of worker threads, as are the
+    triangular solves with the factor.
+    The pool is created on first use and shared by all the sampler threads,
+    and a thread that asks for a factorization also works on it, so that the
+    total number of threads is bounded by the DNest4 threads plus the
+    `threads` - 1 workers (choose them so that this fits the machine).
+
+    In mixed precision, the matrix is factorized in single precision, and
+    the solves are corrected by iterative refinement with the residuals
+    computed in double precision, so that they are accurate to double
+    precision for well-conditioned matrices. The log-determinant comes from
+    the single precision factor; its error is estimated (from the trace of
+    L^-1 A L^-T - I, with a few random vectors) and must be below 0.01.
+    If the factorization fails, the matrix is clearly ill-conditioned, a
+    test solve does not converge or the log-determinant is not accurate
+    enough, the factorization is done in double precision instead. A later
+    solve whose refinement does not converge also switches the factor to
+    double precision (keeping the checked log-determinant).
+*/
+namespace cholesky
+{
+    enum class Precision { full, mixed };
+
+    class Factor
+    {
+        public:
+            Factor() {}
+
+            // factorize A = L L^T, with `threads` threads if A has at least
+            // `threshold` rows (otherwise, or with one thread, with LLT).
+            // Returns false if A is not positive definite
+            bool compute(const Eigen::MatrixXd& A,
+                         unsigned threads=1, size_t threshold=2000,
+                         Precision precision=Precision::full);
+
+            // the precision of the factorization (full, after a fallback)
+            Precision get_precision() const { return precision; }
+
+            // log of the determinant of A
+            double log_determinant() const { return log_det; }
+
+            // false if A is not positive definite, also when found by a
+            // solve that switched to double precision
+            bool ok() const { return factored; }
+
+            // B = A^-1 B; A must be the matrix that was factorized
+            void solve(const Eigen::MatrixXd& A, Eigen::Ref<Eigen::MatrixXd> B) const;
+
+            // r^T A^-1 r
+            double quadratic(const Eigen::MatrixXd& A, const Eigen::VectorXd& r) const;
+
+        private:
+            bool blocked {false};
+            unsigned threads {1};
+            // a solve may switch the factor to double precision
+            mutable Precision precision {Precision::full};
+            mutable Eigen::LLT<Eigen::MatrixXd> llt;
+            mutable Eigen::MatrixXd L;
+            mutable Eigen::MatrixXf L_single;
+            mutable bool factored {false};
+            double log_det {0.};
+
+            bool factor_full(const Eigen::MatrixXd& A) const;
+            bool factor_single(const Eigen::MatrixXd& A);
+            double log_det_error(const Eigen::MatrixXd& A) const;
+            bool refine(const Eigen::MatrixXd& A, Eigen::Ref<Eigen::MatrixXd> B) const;
+            template <typename Rhs>
+            bool refine_impl(const Eigen::MatrixXd& A, Rhs& B) const;
+            template <typename Rhs>
+            void solve_single(Rhs& B) const;
+            // B = L^-1 B, in double precision
+            template <typename Rhs>
+            void solve_lower(Rhs& B) const;
+    };
+
+    // Cholesky factorization of a block-diagonal matrix (up to a
+    // permutation), one Factor for each block. With more than one thread,
+    // the blocks are factorized in parallel
+    class BlockFactor
+    {
+        public:
+            BlockFactor() {}
+
+            // the blocks are the sets of rows i with the same block[i],
+            // numbered from 0
+            void set_blocks(const std::vector<int>& block);
+            size_t size() const { return index.size(); }
+
+            // factorize the diagonal blocks of A, with the same arguments
+            // as Factor::compute. Elements outside the blocks are not used
+            bool compute(const Eigen::MatrixXd& A,
+                         unsigned threads=1, size_t threshold=2000,
+                         Precision precision=Precision::full);
+
+            double log_determinant() const { return log_det; }
+            bool ok() const;
+            void solve(Eigen::Ref<Eigen::MatrixXd> B) const;
+            double quadratic(const Eigen::VectorXd& r) const;
+
+        private:
+            std::vector< std::vector<Eigen::Index> > index;
+            std::vector<Eigen::MatrixXd> A;
+            std::vector<Factor> factors;
+            double log_det {0.};
+    };
+}
+
+#endif
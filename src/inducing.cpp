@@ -0,0 +1,214 @@
+#include "inducing.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace Eigen;
+
+namespace inducing
+{
+
+namespace
+{
+    // added to the diagonal of K_uu, relative to k(0), which is otherwise
+    // numerically singular for inducing points much closer than eta2
+    const double JITTER = 1e-8;
+
+    // number of points in each block of K_uf
+    const size_t BLOCK = 256;
+}
+
+
+void Solver::set_times(const double* t, size_t N, size_t M)
+{
+    this->t = t;
+    this->N = N;
+
+    std::vector<double> sorted(t, t + N);
+    std::sort(sorted.begin(), sorted.end());
+
+    // the quantiles of the times, without repetitions
+    M = std::min(M, N);
+    u.clear();
+    for (size_t m=0; m<M; m++)
+    {
+        double tm = sorted[(2*m + 1) * N / (2*M)];
+        if (u.empty() || tm > u.back())
+            u.push_back(tm);
+    }
+}
+
+
+double Solver::kernel(double tau) const
+{
+    double s = std::sin(M_PI*tau/eta[2]) / eta[3];
+    return eta[0]*eta[0] * std::exp(-0.5*tau*tau/(eta[1]*eta[1]) - 2.0*s*s);
+}
+
+
+void Solver::cross(size_t n0, size_t b, MatrixXd& K) const
+{
+    size_t M = u.size();
+    K.resize(M, b);
+    for (size_t j=0; j<b; j++)
+        for (size_t m=0; m<M; m++)
+            K(m, j) = kernel(t[n0 + j] - u[m]);
+}
+
+
+bool Solver::factor_uu(LLT<MatrixXd>& llt_uu) const
+{
+    size_t M = u.size();
+    double k0 = eta[0]*eta[0];
+
+    MatrixXd Kuu(M, M);
+    for (size_t i=0; i<M; i++)
+    {
+        for (size_t j=0; j<i; j++)
+            Kuu(i, j) = Kuu(j, i) = kernel(u[i] - u[j]);
+        Kuu(i, i) = k0 * (1. + JITTER);
+    }
+    llt_uu.compute(Kuu);
+    return llt_uu.info() == Eigen::Success;
+}
+
+
+bool Solver::factor(double eta1, double eta2, double eta3, double eta4,
+                    const double* diag)
+{
+    eta[0] = eta1; eta[1] = eta2; eta[2] = eta3; eta[3] = eta4;
+    size_t M = u.size();
+    double k0 = eta1*eta1;
+
+    LLT<MatrixXd> llt_uu;
+    if (!factor_uu(llt_uu))
+        return false;
+
+    // one pass over blocks of V = L_uu^-1 K_uf, for
+    // Lambda = diag(K_ff - Q_ff) + diag and A = I + V Lambda^-1 V^T
+    lambda.resize(N);
+    log_det = 0.;
+    MatrixXd A = MatrixXd::Identity(M, M);
+    MatrixXd Vb;
+    for (size_t n0=0; n0<N; n0+=BLOCK)
+    {
+        size_t b = std::min(BLOCK, N - n0);
+        cross(n0, b, Vb);
+        llt_uu.matrixL().solveInPlace(Vb);
+        for (size_t j=0; j<b; j++)
+        {
+            size_t n = n0 + j;
+            lambda(n) = std::max(k0 - Vb.col(j).squaredNorm(), 0.) + diag[n];
+            if (!(lambda(n) > 0.))
+                return false;
+            log_det += std::log(lambda(n));
+        }
+        Vb = Vb * lambda.segment(n0, b).cwiseInverse().cwiseSqrt().asDiagonal();
+        A.selfadjointView<Lower>().rankUpdate(Vb);
+    }
+
+    // log|C| = log|A| + log|Lambda|
+    LLT<MatrixXd> llt_A(A);
+    if (llt_A.info() != Eigen::Success)
+        return false;
+    log_det += 2. * llt_A.matrixLLT().diagonal().array().log().sum();
+
+    R = llt_uu.matrixL().solve(MatrixXd::Identity(M, M));
+    llt_A.matrixL().solveInPlace(R);
+
+    return true;
+}
+
+
+void Solver::solve(Ref<MatrixXd> B) const
+{
+    // C^-1 = Lambda^-1 - Lambda^-1 K_fu R^T R K_uf Lambda^-1
+    B = lambda.cwiseInverse().asDiagonal() * B;
+
+    MatrixXd G = MatrixXd::Zero(u.size(), B.cols()), K;
+    for (size_t n0=0; n0<N; n0+=BLOCK)
+    {
+        size_t b = std::min(BLOCK, N - n0);
+        cross(n0, b, K);
+        G.noalias() += K * B.middleRows(n0, b);
+    }
+    G = R.triangularView<Lower>() * G;
+    G = R.transpose().triangularView<Upper>() * G;
+
+    for (size_t n0=0; n0<N; n0+=BLOCK)
+    {
+        size_t b = std::min(BLOCK, N - n0);
+        cross(n0, b, K);
+        B.middleRows(n0, b).noalias() -=
+            lambda.segment(n0, b).cwiseInverse().asDiagonal() * (K.transpose() * G);
+    }
+}
+
+
+double Solver::quadratic(const VectorXd& r) const
+{
+    VectorXd s = r.cwiseQuotient(lambda);
+
+    VectorXd g = VectorXd::Zero(u.size());
+    MatrixXd K;
+    for (size_t n0=0; n0<N; n0+=BLOCK)
+    {
+        size_t b = std::min(BLOCK, N - n0);
+        cross(n0, b, K);
+        g.noalias() += K * s.segment(n0, b);
+    }
+    VectorXd w = R.triangularView<Lower>() * g;
+    return r.dot(s) - w.squaredNorm();
+}
+
+
+void Solver::compare(const VectorXd& r, size_t n,
+                     double& exact, double& approx) const
+{
+    n = std::min(n, N);
+
+    // every (N/n)th point, in time order
+    std::vector<size_t> order(N);
+    for (size_t i=0; i<N; i++) order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [this](size_t i, size_t j){ return t[i] < t[j]; });
+    std::vector<size_t> subset(n);
+    for (size_t i=0; i<n; i++)
+        subset[i] = order[i * N / n];
+
+    // V on the subset
+    LLT<MatrixXd> llt_uu;
+    factor_uu(llt_uu);
+    MatrixXd V(u.size(), n);
+    for (size_t i=0; i<n; i++)
+        for (size_t m=0; m<u.size(); m++)
+            V(m, i) = kernel(t[subset[i]] - u[m]);
+    llt_uu.matrixL().solveInPlace(V);
+
+    MatrixXd K(n, n), Q(n, n);
+    VectorXd rs(n);
+    double k0 = eta[0]*eta[0];
+    for (size_t i=0; i<n; i++)
+    {
+        size_t a = subset[i];
+        rs(i) = r(a);
+        for (size_t j=0; j<i; j++)
+        {
+            size_t b = subset[j];
+            K(i, j) = K(j, i) = kernel(t[a] - t[b]);
+            Q(i, j) = Q(j, i) = V.col(i).dot(V.col(j));
+        }
+        // the noise is the same in both, lambda - k0 + Q_aa
+        double noise = lambda(a) - std::max(k0 - V.col(i).squaredNorm(), 0.);
+        K(i, i) = k0 + noise;
+        Q(i, i) = lambda(a) + V.col(i).squaredNorm();
+    }
+
+    const double log2pi = std::log(2.*M_PI);
+    LLT<MatrixXd> llt_K(K), llt_Q(Q);
+    exact = -0.5*(n*log2pi + rs.dot(llt_K.solve(rs))
+                  + 2.*llt_K.matrixLLT().diagonal().array().log().sum());
+    approx = -0.5*(n*log2pi + rs.dot(llt_Q.solve(rs))
+                   + 2.*llt_Q.matrixLLT().diagonal().array().log().sum());
+}
+
+}
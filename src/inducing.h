@@ -0,0 +1,80 @@
+#ifndef DNest4_inducing
+#define DNest4_inducing
+
+#include <vector>
+#include <cstddef>
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+
+/*
+    Low-rank approximation to the quasi-periodic kernel of RVmodel,
+        k(tau) = eta1^2 exp(-0.5 tau^2/eta2^2 - 2 sin^2(pi tau/eta3)/eta4^2)
+    with M inducing points u (FITC, Snelson & Ghahramani 2006). The
+    covariance matrix is replaced by
+        C = Q + Lambda,   Q = K_fu K_uu^-1 K_uf,
+    where Lambda is diagonal and holds the variances of the data and the
+    exact diagonal of the kernel, k(0) - Q_nn. Solves and the
+    log-determinant use the Woodbury identity and the matrix determinant
+    lemma, in O(N M^2) operations. Only M x M matrices and the diagonal are
+    kept, in O(N + M^2) memory: the cross-covariances K_uf are evaluated
+    again, in blocks of points, whenever they are needed.
+
+    The inducing points are placed at quantiles of the observation times, so
+    they follow the sampling of the data (and skip the gaps). The
+    approximation improves with M, and is exact when M = N.
+*/
+namespace inducing
+{
+    class Solver
+    {
+        public:
+            Solver() {}
+
+            // set the times of the observations and choose (at most) M
+            // inducing points among them. The times are not copied, and
+            // must outlive the solver (as those of the DataView do)
+            void set_times(const double* t, size_t N, size_t M);
+            size_t size() const { return N; }
+            size_t inducing_points() const { return u.size(); }
+
+            // build and factorize the approximate covariance matrix, with
+            // the diagonal `diag` (in the order of the times given to
+            // set_times). Returns false if it is not positive definite
+            bool factor(double eta1, double eta2, double eta3, double eta4,
+                        const double* diag);
+
+            // log of the determinant of C
+            double log_determinant() const { return log_det; }
+
+            // B = C^-1 B
+            void solve(Eigen::Ref<Eigen::MatrixXd> B) const;
+
+            // r^T C^-1 r
+            double quadratic(const Eigen::VectorXd& r) const;
+
+            // the Gaussian log-likelihood of the residuals r with the exact
+            // and with the approximate covariance matrix, on a subset of
+            // (about) n of the points, spread evenly in time
+            void compare(const Eigen::VectorXd& r, size_t n,
+                         double& exact, double& approx) const;
+
+        private:
+            const double* t {nullptr};  // the times of the observations
+            size_t N {0};
+            std::vector<double> u;      // the times of the inducing points
+            double eta[4] {};
+            Eigen::VectorXd lambda;     // the diagonal Lambda
+            // L_A^-1 L_uu^-1 (lower triangular), with L_uu and L_A the
+            // Cholesky factors of K_uu and of A = I + V Lambda^-1 V^T,
+            // V = L_uu^-1 K_uf. Then V^T A^-1 V = (R K_uf)^T (R K_uf)
+            Eigen::MatrixXd R;
+            double log_det {0.};
+
+            double kernel(double tau) const;
+            // K(m, j) = k(t[n0 + j] - u[m]), for j < b
+            void cross(size_t n0, size_t b, Eigen::MatrixXd& K) const;
+            bool factor_uu(Eigen::LLT<Eigen::MatrixXd>& llt_uu) const;
+    };
+}
+
+#endif
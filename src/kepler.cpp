@@ -0,0 +1,670 @@
+#include "kepler.h"
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// the vectorized kernels use GCC vector extensions and function multiversioning
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KEPLER_SIMD 1
+#else
+#define KEPLER_SIMD 0
+#endif
+
+#if defined(__GNUC__)
+#define KEPLER_INLINE inline __attribute__((always_inline))
+#else
+#define KEPLER_INLINE inline
+#endif
+
+
+namespace kepler
+{
+
+namespace
+{
+    // instruction sets for which there is a batch kernel
+    enum class ISA { scalar, avx2, avx512 };
+
+    #if KEPLER_SIMD
+    typedef double v4d __attribute__((vector_size(32)));
+    typedef double v8d __attribute__((vector_size(64)));
+    #endif
+
+    // pi/2 split in three parts, for the argument reduction in sincos
+    // (Cody-Waite constants, from the Cephes library)
+    const double PIO2_1 = 1.57079625129699707031E0;
+    const double PIO2_2 = 7.54978941586159635336E-8;
+    const double PIO2_3 = 5.39030285815811905290E-15;
+    // and 2*pi, for the reduction of the mean anomaly
+    const double TWOPI_1 = 4*PIO2_1;
+    const double TWOPI_2 = 4*PIO2_2;
+    const double TWOPI_3 = 4*PIO2_3;
+
+    // adding and subtracting 1.5*2^52 rounds a double to the nearest integer
+    const double ROUND_MAGIC = 6755399441055744.0;
+
+
+    /*
+        Lane-generic helpers, V is either double or a vector of doubles.
+        Vectors are passed and returned by reference: the helpers are also
+        instantiated outside the AVX kernels, where passing them by value
+        changes the ABI (-Wpsabi)
+    */
+
+    template <typename V>
+    KEPLER_INLINE void load(const double* p, V& v)
+    {
+        std::memcpy(&v, p, sizeof(V));
+    }
+
+    template <typename V>
+    KEPLER_INLINE void store(double* p, const V& v)
+    {
+        std::memcpy(p, &v, sizeof(V));
+    }
+
+    // r = mask ? a : b, in each lane
+    template <typename M, typename V>
+    KEPLER_INLINE void select(const M& mask, const V& a, const V& b, V& r)
+    {
+        r = mask ? a : b;
+    }
+
+    KEPLER_INLINE bool any(bool mask) { return mask; }
+
+    template <typename M>
+    KEPLER_INLINE bool any(const M& mask)
+    {
+        for (size_t k=0; k<sizeof(M)/sizeof(mask[0]); k++)
+            if (mask[k]) return true;
+        return false;
+    }
+
+    template <typename V>
+    KEPLER_INLINE void vabs(const V& x, V& r) { select(x < 0., -x, x, r); }
+
+    template <typename V>
+    KEPLER_INLINE void vround(const V& x, V& r) { r = (x + ROUND_MAGIC) - ROUND_MAGIC; }
+
+    template <typename V>
+    KEPLER_INLINE void vfloor(const V& x, V& r)
+    {
+        V n;
+        vround(x, n);
+        select(n > x, n - 1., n, r);
+    }
+
+    /**
+        Sine and cosine of x, with the minimax polynomials of the Cephes
+        library on [-pi/4, pi/4]. Accurate to about 1 ulp for |x| < 1e5.
+    */
+    template <typename V>
+    KEPLER_INLINE void vsincos(const V& x, V& s, V& c)
+    {
+        // nearest multiple of pi/2, and the reduced argument
+        V q;
+        vround(x * M_2_PI, q);
+        V r = ((x - q*PIO2_1) - q*PIO2_2) - q*PIO2_3;
+        V z = r*r;
+
+        V sr = r + r*z*(((((1.58962301576546568060E-10*z
+                            - 2.50507477628578072866E-8)*z
+                            + 2.75573136213857245213E-6)*z
+                            - 1.98412698295895385996E-4)*z
+                            + 8.33333333332211858878E-3)*z
+                            - 1.66666666666666307295E-1);
+        V cr = 1. - 0.5*z + z*z*(((((-1.13585365213876817300E-11*z
+                                     + 2.08757008419747316778E-9)*z
+                                     - 2.75573141792967388112E-7)*z
+                                     + 2.48015872888517045348E-5)*z
+                                     - 1.38888888888730564116E-3)*z
+                                     + 4.16666666666665929218E-2);
+
+        // quadrant of x, q mod 4, and its parity
+        // (written with ordered comparisons, GCC scalarizes the equality
+        //  masks of 512-bit vectors)
+        V fq, fm;
+        vfloor(0.25*q, fq);
+        V m = q - 4.*fq;
+        vfloor(0.5*m, fm);
+        V odd = m - 2.*fm;
+        // sine and cosine swap in odd quadrants
+        auto swap = odd > 0.5;
+        V ss, cc, dm;
+        select(swap, cr, sr, ss);
+        select(swap, sr, cr, cc);
+        select(m > 1.5, -ss, ss, s);
+        vabs(m - 1.5, dm);
+        select(dm < 1., -cc, cc, c);
+    }
+
+
+    // largest number of harmonics in the series evaluation of the RV
+    const int MAX_HARMONICS = 12;
+
+    // size of the table of E(M, e), over M in [0, pi] and e in [0, 1]
+    const int TABLE_NM = 1024;
+    const int TABLE_NE = 256;
+    // above this eccentricity, the table needs two corrections
+    const double TABLE_E_ONE_STEP = 0.9;
+    // and above this one, it is too coarse near periastron
+    const double TABLE_E_MAX = 0.99;
+
+    // per-orbit constants shared by all times
+    struct orbit
+    {
+        double n, t_peri, ecc, e2, e3, sqrt1me2, tol;
+
+        // Fourier-Bessel series of the orbit (see series_coefficients),
+        // used when harmonics > 0
+        int harmonics;
+        double a[MAX_HARMONICS+1], b[MAX_HARMONICS+1];
+
+        // the two rows of the table of E(M, e) around this eccentricity and
+        // the interpolation weight between them, if Kepler's equation is
+        // solved with the table (see table_lanes)
+        const double* row;
+        double we;
+        int corrections;
+
+        orbit(double P, double ecc, double t_peri)
+        :n(2.*M_PI/P), t_peri(t_peri), ecc(ecc), e2(ecc*ecc), e3(ecc*ecc*ecc)
+        ,sqrt1me2(std::sqrt(1. - ecc*ecc))
+        ,tol(ecc < 0.8 ? 1e-14 : 1e-13)
+        ,harmonics(0)
+        ,row(nullptr), we(0.), corrections(0)
+        {}
+
+        void use_table(const double* table)
+        {
+            double y = ecc * TABLE_NE;
+            int j = std::min(int(y), TABLE_NE-1);
+            row = table + size_t(j)*TABLE_NM;
+            we = y - j;
+            corrections = ecc > TABLE_E_ONE_STEP ? 2 : 1;
+        }
+    };
+
+    /**
+        Coefficients of the expansion of the true anomaly in harmonics of the
+        mean anomaly (e.g. Murray & Dermott 1999, Eqs. 2.84 and 2.85)
+            cos(f) + e = sum_k a_k cos(kM),    sin(f) = sum_k b_k sin(kM)
+        with a_k = 2(1-e^2)/e J_k(ke) and b_k = 2sqrt(1-e^2) J'_k(ke).
+        Each a_k and b_k is O(e^(k-1)), so truncating at n harmonics is a
+        series in the eccentricity. Finds the smallest n for which the terms
+        left out sum to less than `tol`, and returns 0 if that takes more
+        than MAX_HARMONICS. The series does not converge above e ~ 0.66.
+
+        @param ecc the eccentricity of the orbit, in (0, 0.66)
+        @param tol the tolerated error in cos(f+w) + e*cos(w)
+        @return number of harmonics n, or 0
+    */
+    int series_coefficients(double ecc, double tol, double* a, double* b)
+    {
+        // a few more terms than needed, to bound the tail of the series
+        const int kmax = MAX_HARMONICS + 6;
+        double c[kmax+1];
+        double sqrt1me2 = std::sqrt(1. - ecc*ecc);
+
+        for (int k=1; k<=kmax; k++)
+        {
+            double ak = 2.*(1. - ecc*ecc)/ecc * jn(k, k*ecc);
+            double bk = sqrt1me2 * (jn(k-1, k*ecc) - jn(k+1, k*ecc));
+            if (k <= MAX_HARMONICS)
+            {
+                a[k] = ak;
+                b[k] = bk;
+            }
+            c[k] = std::abs(ak) + std::abs(bk);
+        }
+
+        // error when keeping MAX_HARMONICS terms; the terms decay
+        // geometrically, so extrapolate beyond kmax
+        double ratio = c[kmax]/c[kmax-1];
+        if (!(ratio < 1.)) return 0;
+        double tail = c[kmax]*ratio/(1. - ratio);
+        for (int k=kmax; k>MAX_HARMONICS; k--)
+            tail += c[k];
+        if (tail > tol) return 0;
+
+        // and drop harmonics while the error allows
+        for (int n=MAX_HARMONICS; n>1; n--)
+        {
+            if (tail + c[n] > tol) return n;
+            tail += c[n];
+        }
+        return 1;
+    }
+
+    // mean anomaly at the times t, reduced to [0, 2pi)
+    template <typename V>
+    KEPLER_INLINE void mean_anomaly(const V& t, const orbit& o, V& M)
+    {
+        V Mt = o.n * (t - o.t_peri);
+        V k;
+        vfloor(Mt * (0.5*M_1_PI), k);
+        M = ((Mt - k*TWOPI_1) - k*TWOPI_2) - k*TWOPI_3;
+    }
+
+    /**
+        Solves Kepler's equation at the times t by interpolation in the table
+        of E(M, e), followed by a fixed number of corrections of fourth order
+        (Danby 1988, Eq. 6.6.7), which bring the bilinear interpolation to
+        double precision. There is no data-dependent loop.
+    */
+    template <typename V>
+    KEPLER_INLINE void table_lanes(const V& t, const orbit& o, V& E, V& cosE, V& sinE)
+    {
+        const size_t W = sizeof(V)/sizeof(double);
+        const double e = o.ecc;
+
+        V M;
+        mean_anomaly(t, o, M);
+
+        // the table covers [0, pi], and E(2pi - M) = 2pi - E(M)
+        auto upper = M > M_PI;
+        V x;
+        select(upper, 2.*M_PI - M, M, x);
+        x = x * ((TABLE_NM-1)*M_1_PI);
+
+        double xs[W], Es[W];
+        store(xs, x);
+        const double* r0 = o.row;
+        const double* r1 = o.row + TABLE_NM;
+        for (size_t k=0; k<W; k++)
+        {
+            int i = std::min(int(xs[k]), TABLE_NM-2);
+            double wM = xs[k] - i;
+            double E0 = r0[i] + wM*(r0[i+1] - r0[i]);
+            double E1 = r1[i] + wM*(r1[i+1] - r1[i]);
+            Es[k] = E0 + o.we*(E1 - E0);
+        }
+        load(Es, E);
+        select(upper, 2.*M_PI - E, E, E);
+
+        for (int n=0; n<o.corrections; n++)
+        {
+            vsincos(E, sinE, cosE);
+            V f = E - e*sinE - M;
+            V f1 = 1. - e*cosE;
+            V f2 = e*sinE;
+            V f3 = e*cosE;
+            V d1 = -f/f1;
+            V d2 = -f/(f1 + 0.5*d1*f2);
+            V d3 = -f/(f1 + 0.5*d2*f2 + (1./6.)*d2*d2*f3);
+            E = E + d3;
+        }
+        vsincos(E, sinE, cosE);
+    }
+
+    /**
+        Solves Kepler's equation at the times t, with the starting value and
+        iteration of RVmodel::keplerstart3 and RVmodel::eps3. All lanes iterate
+        until the slowest one has converged.
+    */
+    template <typename V>
+    KEPLER_INLINE void solve_lanes(const V& t, const orbit& o, V& E, V& cosE, V& sinE)
+    {
+        if (o.row)
+        {
+            table_lanes(t, o, E, cosE, sinE);
+            return;
+        }
+
+        const double e = o.ecc;
+
+        V M;
+        mean_anomaly(t, o, M);
+
+        // starting value
+        V sM, cM;
+        vsincos(M, sM, cM);
+        E = M + (-0.5*o.e3 + e + (o.e2 + 1.5*cM*o.e3)*cM)*sM;
+
+        V dE = V{} + 0.;
+        for (int count=0; count<100; count++)
+        {
+            vsincos(E, sinE, cosE);
+            V t2 = -1. + e*cosE;
+            V t4 = e*sinE;
+            V t5 = -E + t4 + M;
+            V t6 = t5/(0.5*t5*t4/t2 + t2);
+            // the third-order term of Murison's correction vanishes in
+            // RVmodel::eps3 (1/6 is an integer division), keep the same iteration
+            dE = t5/(0.5*sinE*e*t6 + t2);
+            E = E - dE;
+            V absdE;
+            vabs(dE, absdE);
+            if (!any(absdE > o.tol)) break;
+        }
+
+        // bring sine and cosine to the last E, to first order in dE
+        V c = cosE + dE*sinE;
+        sinE = sinE - dE*cosE;
+        cosE = c;
+    }
+
+    // radial velocity of a circular orbit, K cos(M + w)
+    template <typename V>
+    KEPLER_INLINE void circular_lanes(const V& t, const orbit& o,
+                                      double Kcosw, double Ksinw, V& rv)
+    {
+        V M, sM, cM;
+        mean_anomaly(t, o, M);
+        vsincos(M, sM, cM);
+        rv = Kcosw*cM - Ksinw*sM;
+    }
+
+    // radial velocity from the series in harmonics of the mean anomaly
+    template <typename V>
+    KEPLER_INLINE void series_lanes(const V& t, const orbit& o,
+                                    double Kcosw, double Ksinw, V& rv)
+    {
+        V M, s1, c1;
+        mean_anomaly(t, o, M);
+        vsincos(M, s1, c1);
+        // cos(kM) and sin(kM) by the Chebyshev recurrence
+        V ck = c1, sk = s1;
+        V ckm1 = V{} + 1., skm1 = V{} + 0.;
+        V A = o.a[1]*c1, B = o.b[1]*s1;
+        for (int k=2; k<=o.harmonics; k++)
+        {
+            V c = 2.*c1*ck - ckm1;
+            V s = 2.*c1*sk - skm1;
+            ckm1 = ck; skm1 = sk;
+            ck = c; sk = s;
+            A = A + o.a[k]*ck;
+            B = B + o.b[k]*sk;
+        }
+        rv = Kcosw*A - Ksinw*B;
+    }
+
+    // radial velocity from the solution of Kepler's equation
+    template <typename V>
+    KEPLER_INLINE void solver_lanes(const V& t, const orbit& o,
+                                    double Kcosw, double Ksinw, V& rv)
+    {
+        V E, cosE, sinE;
+        solve_lanes(t, o, E, cosE, sinE);
+        V denom = 1. - o.ecc*cosE;
+        rv = (Kcosw*(cosE - o.ecc) - Ksinw*o.sqrt1me2*sinE)/denom + Kcosw*o.ecc;
+    }
+
+    template <typename V>
+    KEPLER_INLINE void keplerian_impl(const double* t, size_t N, const orbit& o,
+                                      double K, double w, double* rv)
+    {
+        const size_t W = sizeof(V)/sizeof(double);
+        // cos(f+w) + e*cos(w) = cos(f)cos(w) - sin(f)sin(w) + e*cos(w)
+        const double Kcosw = K*std::cos(w), Ksinw = K*std::sin(w);
+
+        size_t i = 0;
+        if (o.ecc == 0.)
+        {
+            for (; i+W <= N; i+=W)
+            {
+                V ti, rvi;
+                load(t+i, ti);
+                circular_lanes(ti, o, Kcosw, Ksinw, rvi);
+                store(rv+i, rvi);
+            }
+            for (; i<N; i++)
+                circular_lanes(t[i], o, Kcosw, Ksinw, rv[i]);
+        }
+        else if (o.harmonics > 0)
+        {
+            for (; i+W <= N; i+=W)
+            {
+                V ti, rvi;
+                load(t+i, ti);
+                series_lanes(ti, o, Kcosw, Ksinw, rvi);
+                store(rv+i, rvi);
+            }
+            for (; i<N; i++)
+                series_lanes(t[i], o, Kcosw, Ksinw, rv[i]);
+        }
+        else
+        {
+            for (; i+W <= N; i+=W)
+            {
+                V ti, rvi;
+                load(t+i, ti);
+                solver_lanes(ti, o, Kcosw, Ksinw, rvi);
+                store(rv+i, rvi);
+            }
+            for (; i<N; i++)
+                solver_lanes(t[i], o, Kcosw, Ksinw, rv[i]);
+        }
+    }
+
+
+    /* One instantiation of the kernels per instruction set */
+
+    void keplerian_scalar(const double* t, size_t N, const orbit& o,
+                          double K, double w, double* rv)
+    { keplerian_impl<double>(t, N, o, K, w, rv); }
+
+    #if KEPLER_SIMD
+    __attribute__((target("avx2,fma")))
+    void keplerian_avx2(const double* t, size_t N, const orbit& o,
+                        double K, double w, double* rv)
+    { keplerian_impl<v4d>(t, N, o, K, w, rv); }
+
+    __attribute__((target("avx512f")))
+    void keplerian_avx512(const double* t, size_t N, const orbit& o,
+                          double K, double w, double* rv)
+    { keplerian_impl<v8d>(t, N, o, K, w, rv); }
+    #endif
+
+    ISA detect_isa()
+    {
+        #if KEPLER_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return ISA::avx512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return ISA::avx2;
+        #endif
+        return ISA::scalar;
+    }
+
+    // the instruction set used by the batch kernels on this CPU
+    ISA isa()
+    {
+        static const ISA selected = detect_isa();
+        return selected;
+    }
+
+
+    /* The table of E(M, e) */
+
+    // header of a table file, padded so that the data is 64-byte aligned
+    struct table_header
+    {
+        char magic[8];
+        int32_t nM, ne;
+        char padding[48];
+    };
+    const char TABLE_MAGIC[8] = {'k', 'i', 'm', 'a', 'E', 'M', 'e', '1'};
+    const size_t TABLE_SIZE = size_t(TABLE_NM) * (TABLE_NE + 1);
+
+    // the table loaded by load_table, if any
+    std::vector<double> table_storage;
+    const double* table_data = nullptr;
+
+    /**
+        Fills the table of E(M, e), with TABLE_NE+1 rows of eccentricity
+        e_j = j/TABLE_NE and TABLE_NM columns of mean anomaly M_i in [0, pi].
+        Each value is found by Newton's method, safeguarded by bisection
+        (for M in [0, pi], E is in [0, pi] and f(E) = E - e sin(E) - M is
+        monotonic), starting from the value at the previous M.
+    */
+    void build_table(double* table)
+    {
+        for (int j=0; j<=TABLE_NE; j++)
+        {
+            double e = double(j) / TABLE_NE;
+            double* row = table + size_t(j)*TABLE_NM;
+            double E = 0.;
+            for (int i=0; i<TABLE_NM; i++)
+            {
+                double M = M_PI * i / (TABLE_NM-1);
+                double lo = 0., hi = M_PI;
+                for (int count=0; count<100; count++)
+                {
+                    double f = E - e*std::sin(E) - M;
+                    if (f == 0.) break;
+                    if (f < 0.) lo = E; else hi = E;
+                    double Enew = E - f/(1. - e*std::cos(E));
+                    if (!(Enew > lo && Enew < hi))
+                        Enew = 0.5*(lo + hi);
+                    if (std::abs(Enew - E) < 1e-15) { E = Enew; break; }
+                    E = Enew;
+                }
+                row[i] = E;
+            }
+        }
+    }
+
+    // the table, built on first use if load_table was not called
+    const double* table()
+    {
+        if (table_data) return table_data;
+        static const std::vector<double> built = [] {
+            std::vector<double> tab(TABLE_SIZE);
+            build_table(tab.data());
+            return tab;
+        }();
+        return built.data();
+    }
+
+} // anonymous namespace
+
+
+void load_table(const char* filename)
+{
+    const size_t bytes = sizeof(table_header) + TABLE_SIZE*sizeof(double);
+
+    // map the file, if it holds a table of the right size
+    int fd = open(filename, O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && size_t(st.st_size) == bytes)
+        {
+            void* map = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                const table_header* h = static_cast<const table_header*>(map);
+                if (std::memcmp(h->magic, TABLE_MAGIC, 8) == 0 &&
+                    h->nM == TABLE_NM && h->ne == TABLE_NE)
+                {
+                    close(fd);
+                    // the mapping stays for the rest of the run
+                    table_data = reinterpret_cast<const double*>(h + 1);
+                    printf("# Mapped Kepler table from %s\n", filename);
+                    return;
+                }
+                munmap(map, bytes);
+            }
+        }
+        close(fd);
+    }
+
+    // otherwise build it, and save it for the next run
+    table_storage.resize(TABLE_SIZE);
+    build_table(table_storage.data());
+    table_data = table_storage.data();
+
+    table_header h = {};
+    std::memcpy(h.magic, TABLE_MAGIC, 8);
+    h.nM = TABLE_NM;
+    h.ne = TABLE_NE;
+    FILE* f = fopen(filename, "wb");
+    if (f && fwrite(&h, sizeof(h), 1, f) == 1 &&
+        fwrite(table_data, sizeof(double), TABLE_SIZE, f) == TABLE_SIZE)
+        printf("# Saved Kepler table to %s\n", filename);
+    else
+        printf("# Could not save Kepler table to %s\n", filename);
+    if (f) fclose(f);
+}
+
+
+void keplerian(const double* t, size_t N,
+               double P, double K, double ecc, double w, double t_peri,
+               double* rv, double tolerance, Solver solver)
+{
+    orbit o(P, ecc, t_peri);
+    if (ecc > 0. && tolerance > 0. && ecc < 0.66)
+        o.harmonics = series_coefficients(ecc, tolerance/std::abs(K), o.a, o.b);
+    if (solver == Solver::table && ecc > 0. && ecc <= TABLE_E_MAX && o.harmonics == 0)
+        o.use_table(table());
+
+    switch (isa())
+    {
+        #if KEPLER_SIMD
+        case ISA::avx512: keplerian_avx512(t, N, o, K, w, rv); break;
+        case ISA::avx2: keplerian_avx2(t, N, o, K, w, rv); break;
+        #endif
+        default: keplerian_scalar(t, N, o, K, w, rv);
+    }
+}
+
+void keplerian_batch(const double* t, size_t N, double t_first,
+                     const double* params, size_t S, size_t planets,
+                     double* rv, double tolerance, int threads)
+{
+    // times relative to t_first, as RVmodel's t_since_first
+    std::vector<double> tt(t, t + N);
+    for (double& ti : tt)
+        ti -= t_first;
+
+    size_t nthreads = threads > 0 ? threads : std::thread::hardware_concurrency();
+    nthreads = std::max<size_t>(1, std::min(nthreads, S));
+
+    auto work = [&](size_t first, size_t last)
+    {
+        std::vector<double> planet(N);
+        for (size_t s=first; s<last; s++)
+        {
+            double* out = rv + s*N;
+            std::fill(out, out + N, 0.);
+            for (size_t j=0; j<planets; j++)
+            {
+                const double* p = params + (s*planets + j)*5;
+                double P = p[0], K = p[1], phi = p[2], ecc = p[3], w = p[4];
+                if (P == 0.) continue;
+                keplerian(tt.data(), N, P, K, ecc, w, -(P*phi)/(2.*M_PI),
+                          planet.data(), tolerance);
+                for (size_t i=0; i<N; i++)
+                    out[i] += planet[i];
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t k=1; k<nthreads; k++)
+        pool.emplace_back(work, k*S/nthreads, (k+1)*S/nthreads);
+    work(0, S/nthreads);
+    for (auto& thread : pool)
+        thread.join();
+}
+
+} // namespace kepler
+
+
+void kepler_keplerian_batch(const double* t, size_t N, double t_first,
+                            const double* params, size_t S, size_t planets,
+                            double* rv, double tolerance, int threads)
+{
+    kepler::keplerian_batch(t, N, t_first, params, S, planets, rv, tolerance,
+                            threads);
+}
@@ -0,0 +1,62 @@
+#ifndef DNest4_kepler
+#define DNest4_kepler
+
+#include <cstddef>
+
+/*
+    Batched Keplerian solver.
+    Solves Kepler's equation for a whole array of times in one call, with the
+    same iteration as RVmodel::ecc_anomaly (Murison 2006). The kernels are
+    vectorized for AVX2 and AVX-512, and the widest one supported by the CPU
+    is picked at runtime, with a scalar fallback.
+    Kepler's equation can also be solved by interpolation in a precomputed
+    table of E(M, e), see Solver::table.
+*/
+namespace kepler
+{
+    // methods to solve Kepler's equation
+    enum class Solver
+    {
+        // the iteration of RVmodel::ecc_anomaly, until convergence
+        iterative,
+        // bilinear interpolation in a table of E(M, e), followed by one
+        // fourth-order (Danby) correction, or two if e > 0.9; orbits with
+        // e > 0.99 still use the iteration
+        table
+    };
+
+    // memory-map the table of E(M, e) from the file `filename`, or build it
+    // and save it there if the file doesn't exist (or is not a valid table).
+    // Otherwise, the table is built in memory the first time it is needed.
+    // Call it before the sampler starts.
+    void load_table(const char* filename);
+
+    // radial velocity of one Keplerian orbit at the N times t,
+    // rv[i] = K * (cos(f_i + w) + ecc*cos(w))
+    // Circular orbits are evaluated in closed form. If tolerance > 0, orbits
+    // of low eccentricity use a series in harmonics of the mean anomaly,
+    // truncated where its error stays below tolerance (in units of K, m/s),
+    // and only the others solve Kepler's equation.
+    void keplerian(const double* t, size_t N,
+                   double P, double K, double ecc, double w, double t_peri,
+                   double* rv, double tolerance=0.,
+                   Solver solver=Solver::iterative);
+
+    // the sum of the Keplerians of each of S samples at the N times t, as in
+    // RVmodel::calculate_mu. params has, for each sample, `planets` rows of
+    // (P, K, phi, ecc, w), where phi is the mean anomaly at t_first (the
+    // first time of the data); rows with P == 0 are not planets. rv is S x N.
+    // tolerance is that of keplerian (RVmodel uses kepler_tolerance*sig_min).
+    // The samples are split among `threads` threads (all cores if <= 0)
+    void keplerian_batch(const double* t, size_t N, double t_first,
+                         const double* params, size_t S, size_t planets,
+                         double* rv, double tolerance=0., int threads=0);
+}
+
+// C interface to keplerian_batch, for pykima (pykima/libkepler.so)
+extern "C" void kepler_keplerian_batch(const double* t, size_t N, double t_first,
+                                       const double* params, size_t S,
+                                       size_t planets, double* rv,
+                                       double tolerance, int threads);
+
+#endif
@@ -20,7 +20,6 @@ const bool multi_instrument = false;
 
 RVmodel::RVmodel()
 :planets(5, 0, true, RVConditionalPrior())
-,mu(Data::get_instance().get_t().size())
 ,C(Data::get_instance().get_t().size(), Data::get_instance().get_t().size())
 {
     auto data = Data::get_instance();
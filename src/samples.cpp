@@ -0,0 +1,132 @@
+#include "samples.h"
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace samples
+{
+
+namespace
+{
+    const char MAGIC[8] = {'K', 'I', 'M', 'A', 'S', 'M', 'P', '\0'};
+    const uint32_t VERSION = 1;
+
+    size_t align64(size_t n) { return (n + 63) / 64 * 64; }
+}
+
+
+Writer::~Writer()
+{
+    if (!file)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    queued.notify_one();
+    thread.join();
+    std::fclose(file);
+}
+
+
+void Writer::open(const char* filename, const std::string& names, size_t ncols)
+{
+    file = std::fopen(filename, "wb");
+    if (!file)
+    {
+        printf("Could not open file (%s)!\n", filename);
+        exit(1);
+    }
+    this->ncols = ncols;
+
+    uint32_t names_size = names.size() + 1;
+    uint32_t offset = align64(64 + names_size);
+    uint32_t columns = ncols;
+
+    std::vector<char> header(offset, 0);
+    memcpy(&header[0], MAGIC, 8);
+    memcpy(&header[8], &VERSION, 4);
+    memcpy(&header[12], &offset, 4);
+    memcpy(&header[16], &columns, 4);
+    memcpy(&header[20], &names_size, 4);
+    memcpy(&header[64], names.c_str(), names_size);
+    std::fwrite(header.data(), 1, header.size(), file);
+    std::fflush(file);
+
+    thread = std::thread(&Writer::run, this);
+}
+
+
+void Writer::write(const std::vector<double>& record)
+{
+    if (record.size() != ncols)
+    {
+        printf("A sample has %d values instead of %d!\n", (int) record.size(), (int) ncols);
+        exit(1);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        written.wait(lock, [this]{ return queue.size() < MAX_QUEUED; });
+        queue.insert(queue.end(), record.begin(), record.end());
+    }
+    queued.notify_one();
+}
+
+
+void Writer::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    written.wait(lock, [this]{ return queue.empty() && !writing; });
+}
+
+
+void Writer::run()
+{
+    std::vector<double> buffer;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        queued.wait(lock, [this]{ return done || !queue.empty(); });
+        if (queue.empty() && done)
+            break;
+
+        // write outside the lock, while new records are queued
+        buffer.swap(queue);
+        writing = true;
+        written.notify_all();
+        lock.unlock();
+        std::fwrite(buffer.data(), sizeof(double), buffer.size(), file);
+        std::fflush(file);
+        buffer.clear();
+        lock.lock();
+        writing = false;
+        written.notify_all();
+    }
+}
+
+
+Writer& writer()
+{
+    static Writer instance;
+    return instance;
+}
+
+
+void discard_text(const char* filename, bool discard)
+{
+    char target[16] = {0};
+    struct stat st;
+    bool linked = lstat(filename, &st) == 0 && S_ISLNK(st.st_mode) &&
+                  readlink(filename, target, sizeof(target) - 1) > 0 &&
+                  strcmp(target, "/dev/null") == 0;
+    if (linked == discard)
+        return;
+
+    unlink(filename);
+    if (discard && symlink("/dev/null", filename) != 0)
+        printf("# Could not link %s to /dev/null, it will have empty lines\n", filename);
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef DNest4_samples
+#define DNest4_samples
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+    Binary output of the samples (RVmodel's binary_samples option), read by
+    pykima with np.memmap. The file starts with a header of 64 bytes
+    (little-endian)
+        magic "KIMASMP\0", version, offset of the records, number of
+        columns, size of the column names
+    followed by the column names (RVmodel::description, zero-terminated),
+    and from the offset (a multiple of 64) by one record per sample, with
+    the same values as a line of sample.txt as float64.
+
+    The records are queued in memory and written to disk by a background
+    thread, so that the sampler only waits for the file if it falls behind
+    by more than Writer::MAX_QUEUED values. A record that was being written
+    when the run stopped is incomplete, and is ignored.
+
+    DNest4 still opens sample.txt for each sample, to write the (empty)
+    line of RVmodel::print, so sample.txt is made a link to /dev/null.
+*/
+namespace samples
+{
+    class Writer
+    {
+        public:
+            Writer() {}
+            // writes what is queued, and closes the file
+            ~Writer();
+
+            Writer(const Writer&) = delete;
+            Writer& operator=(const Writer&) = delete;
+
+            // start writing to `filename` (replacing it), records of `ncols`
+            // values described by `names`
+            void open(const char* filename, const std::string& names, size_t ncols);
+            bool is_open() const { return file != nullptr; }
+
+            // queue one record, waiting if too much is queued already
+            void write(const std::vector<double>& record);
+
+            // wait until everything queued is in the file
+            void flush();
+
+            // 32 MB of values, written while the next ones are queued
+            static const size_t MAX_QUEUED = 1 << 22;
+
+        private:
+            std::FILE* file {nullptr};
+            size_t ncols {0};
+
+            std::thread thread;
+            std::mutex mutex;
+            std::condition_variable queued, written;
+            std::vector<double> queue;
+            bool writing {false};
+            bool done {false};
+
+            void run();
+    };
+
+    // the writer of sample.bin, shared by all the particles
+    Writer& writer();
+
+    // make the text output `filename` a link to /dev/null (if discard), or
+    // remove such a link left by a previous run (otherwise)
+    void discard_text(const char* filename, bool discard);
+}
+
+#endif
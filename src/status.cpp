@@ -0,0 +1,315 @@
+#include "status.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace status
+{
+
+namespace
+{
+    double logaddexp(double x1, double x2)
+    {
+        if (x1 < x2)
+            swap(x1, x2);
+        if (x2 == -numeric_limits<double>::infinity())
+            return x1;
+        return log1p(exp(x2 - x1)) + x1;
+    }
+
+    double logdiffexp(double x1, double x2)
+    {
+        return log(1. - exp(x2 - x1)) + x1;
+    }
+
+    // the rows of the first `ncols` columns of levels.txt or
+    // sample_info.txt, from `offset`, up to the last complete line
+    vector< vector<double> > read_rows(const char* filename, size_t ncols,
+                                       long long& offset)
+    {
+        vector< vector<double> > rows;
+        ifstream fin(filename, ios::binary);
+        if (!fin)
+            return rows;
+        fin.seekg(offset);
+
+        string line;
+        while (getline(fin, line))
+        {
+            if (fin.eof())  // no newline, still being written
+                break;
+            offset += line.size() + 1;
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            istringstream cells(line);
+            vector<double> row(ncols);
+            for (size_t j=0; j<ncols; j++)
+                cells >> row[j];
+            if (!cells)
+                break;
+            rows.push_back(row);
+        }
+        return rows;
+    }
+}
+
+
+void Estimator::Level::add(const Sample& sample)
+{
+    if (sample.logL > max)
+    {
+        double scale = exp(max - sample.logL);
+        sum *= scale;
+        sum_logL *= scale;
+        for (double& s : sum_Np)
+            s *= scale;
+        max = sample.logL;
+    }
+    double w = exp(sample.logL - max);
+    n++;
+    sum += w;
+    sum_logL += w * sample.logL;
+    if (sample.Np >= 0)
+    {
+        if ((size_t) sample.Np >= sum_Np.size())
+            sum_Np.resize(sample.Np + 1, 0.);
+        sum_Np[sample.Np] += w;
+    }
+}
+
+
+int Estimator::sandwich(const Sample& sample, int level) const
+{
+    int L = levels.size();
+    while (level < L-1 &&
+           (sample.logL > levels[level+1].logL ||
+            (sample.logL == levels[level+1].logL &&
+             sample.tiebreaker >= levels[level+1].tiebreaker)))
+        level++;
+    return level;
+}
+
+
+void Estimator::set_levels(const vector<double>& logX,
+                           const vector<double>& logL,
+                           const vector<double>& tiebreaker)
+{
+    // a file being rewritten may be short
+    if (logX.size() < levels.size())
+        return;
+    for (size_t i=0; i<levels.size(); i++)
+        levels[i].logX = logX[i];
+    if (logX.size() == levels.size())
+        return;
+
+    size_t old_top = levels.size();
+    for (size_t i=old_top; i<logX.size(); i++)
+    {
+        levels.emplace_back();
+        levels[i].logX = logX[i];
+        levels[i].logL = logL[i];
+        levels[i].tiebreaker = tiebreaker[i];
+    }
+    if (old_top == 0)
+        return;
+
+    // the samples of the previous last level may be above the new ones
+    vector<Sample> moved;
+    moved.swap(top);
+    Level& previous = levels[old_top-1];
+    previous.n = 0;
+    previous.max = -numeric_limits<double>::infinity();
+    previous.sum = previous.sum_logL = 0.;
+    previous.sum_Np.clear();
+    for (const Sample& sample : moved)
+    {
+        int i = sandwich(sample, old_top-1);
+        levels[i].add(sample);
+        if (i == (int) levels.size()-1)
+            top.push_back(sample);
+    }
+}
+
+
+bool Estimator::add_sample(int level, double logL, double tiebreaker, int Np)
+{
+    if (level < 0 || level >= (int) levels.size())
+        return false;
+    Sample sample {logL, tiebreaker, Np};
+    int i = sandwich(sample, level);
+    levels[i].add(sample);
+    if (i == (int) levels.size()-1)
+        top.push_back(sample);
+    samples++;
+    return true;
+}
+
+
+bool Estimator::estimate(Estimates& estimates) const
+{
+    size_t L = levels.size();
+    if (L == 0 || samples == 0)
+        return false;
+
+    // the prior weight of each sample of a level, the normalisation of
+    // the prior weights and the evidence (up to that normalisation)
+    vector<double> logp(L);
+    double norm = -numeric_limits<double>::infinity();
+    double logW = -numeric_limits<double>::infinity();
+    for (size_t i=0; i<L; i++)
+    {
+        const Level& level = levels[i];
+        if (level.n == 0)
+            continue;
+        double logx_min = (i == L-1) ? -1E300 : levels[i+1].logX;
+        logp[i] = logdiffexp(level.logX, logx_min) - log(level.n + 1.);
+        norm = logaddexp(norm, logp[i] + log(level.n));
+        logW = logaddexp(logW, logp[i] + level.max + log(level.sum));
+    }
+    double logZ = logW - norm;
+
+    // with the posterior weight P = exp(logp + log(L) - logW) of a sample
+    estimates.samples = samples;
+    estimates.levels = L;
+    estimates.logZ = logZ;
+    estimates.H = -logZ;
+    estimates.Np.clear();
+    double entropy = 0.;
+    for (size_t i=0; i<L; i++)
+    {
+        const Level& level = levels[i];
+        if (level.n == 0)
+            continue;
+        double P = exp(logp[i] + level.max - logW);
+        estimates.H += P * level.sum_logL;
+        entropy -= P * ((logp[i] - logW) * level.sum + level.sum_logL);
+        if (level.sum_Np.size() > estimates.Np.size())
+            estimates.Np.resize(level.sum_Np.size(), 0.);
+        for (size_t k=0; k<level.sum_Np.size(); k++)
+            estimates.Np[k] += P * level.sum_Np[k];
+    }
+    estimates.ESS = exp(entropy);
+
+    return true;
+}
+
+
+Monitor::~Monitor()
+{
+    if (!started)
+        return;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    stop.notify_one();
+    thread.join();
+    update();
+}
+
+
+void Monitor::start(double interval, const char* filename)
+{
+    this->filename = filename;
+    this->interval = interval;
+    started = true;
+    thread = std::thread(&Monitor::run, this);
+}
+
+
+void Monitor::add_sample(int Np)
+{
+    lock_guard<std::mutex> lock(mutex);
+    this->Np.push_back(Np);
+}
+
+
+void Monitor::run()
+{
+    auto period = chrono::duration<double>(interval);
+    unique_lock<std::mutex> lock(mutex);
+    while (!stop.wait_for(lock, period, [this]{ return done; }))
+    {
+        lock.unlock();
+        update();
+        lock.lock();
+    }
+}
+
+
+void Monitor::update()
+{
+    // levels.txt is rewritten every time, sample_info.txt is appended to
+    long long levels_offset = 0;
+    vector<double> logX, logL, tiebreaker;
+    for (auto& row : read_rows("levels.txt", 3, levels_offset))
+    {
+        logX.push_back(row[0]);
+        logL.push_back(row[1]);
+        tiebreaker.push_back(row[2]);
+    }
+    estimator.set_levels(logX, logL, tiebreaker);
+
+    for (auto& row : read_rows("sample_info.txt", 3, info_offset))
+        pending.push_back(row);
+
+    // in order, up to the first sample whose level or number of planets
+    // is not known yet
+    size_t added = 0;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        while (added < pending.size() && added < Np.size())
+        {
+            auto& row = pending[added];
+            if (!estimator.add_sample((int) row[0], row[1], row[2], Np[added]))
+                break;
+            added++;
+        }
+        Np.erase(Np.begin(), Np.begin() + added);
+    }
+    pending.erase(pending.begin(), pending.begin() + added);
+
+    Estimates estimates;
+    if (!estimator.estimate(estimates))
+        return;
+
+    // write a new file and replace the old one, so that it is never seen
+    // half-written
+    string temporary = filename + ".tmp";
+    FILE* fout = fopen(temporary.c_str(), "w");
+    if (!fout)
+        return;
+    time_t rawtime;
+    time(&rawtime);
+    fprintf(fout, ";%s\n", ctime(&rawtime));
+    fprintf(fout, "[status]\n");
+    fprintf(fout, "samples: %zu\n", estimates.samples);
+    fprintf(fout, "levels: %zu\n", estimates.levels);
+    fprintf(fout, "logZ: %.6f\n", estimates.logZ);
+    fprintf(fout, "H: %.6f\n", estimates.H);
+    fprintf(fout, "ESS: %.2f\n", estimates.ESS);
+    fprintf(fout, "Np: ");
+    for (double p : estimates.Np)
+        fprintf(fout, "%.6f,", p);
+    fprintf(fout, "\n");
+    fclose(fout);
+    rename(temporary.c_str(), filename.c_str());
+}
+
+
+Monitor& monitor()
+{
+    static Monitor instance;
+    return instance;
+}
+
+}
@@ -0,0 +1,128 @@
+#ifndef DNest4_status
+#define DNest4_status
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+
+/*
+    Estimates of the evidence and the posterior while kima runs (RVmodel's
+    status_interval option). A background thread follows levels.txt and
+    sample_info.txt as DNest4 writes them, reading only what was added to
+    sample_info.txt since the last time, and periodically writes a small
+    status file with log(Z), the information H, the effective sample size
+    of the posterior and the posterior of the number of planets.
+
+    The estimates are those of pykima's postprocess with numResampleLogX=1
+    (the log(X) of the samples of each level evenly spaced between the
+    level and the next one), and without cutting the start of the run.
+    With even spacing, the n samples of a level all have the same prior
+    weight, (X_i - X_{i+1}) / (n + 1), so only the number of samples of
+    each level and running sums of their likelihoods are kept.
+*/
+namespace status
+{
+    struct Estimates
+    {
+        size_t samples {0}, levels {0};
+        double logZ {0.}, H {0.}, ESS {0.};
+        // the posterior probability of 0, 1, ... planets
+        std::vector<double> Np;
+    };
+
+    class Estimator
+    {
+        public:
+            // the columns of levels.txt: log(X), log(L) and tiebreaker.
+            // Levels are only added, but their log(X) may change
+            void set_levels(const std::vector<double>& logX,
+                            const std::vector<double>& logL,
+                            const std::vector<double>& tiebreaker);
+
+            // a sample of sample_info.txt (level, log(L) and tiebreaker)
+            // and its number of planets. Returns false if its level is not
+            // in levels.txt (yet)
+            bool add_sample(int level, double logL, double tiebreaker, int Np);
+
+            // the estimates from all samples so far, in O(levels)
+            bool estimate(Estimates& estimates) const;
+
+        private:
+            struct Sample
+            {
+                double logL, tiebreaker;
+                int Np;
+            };
+
+            // the samples whose highest level below them, in (log(L),
+            // tiebreaker), is this one
+            struct Level
+            {
+                double logX, logL, tiebreaker;
+                size_t n {0};
+                // the sums of exp(log(L) - max) and exp(log(L) - max)*log(L)
+                // over the samples, and of exp(log(L) - max) for each
+                // number of planets
+                double max {-std::numeric_limits<double>::infinity()};
+                double sum {0.}, sum_logL {0.};
+                std::vector<double> sum_Np;
+
+                void add(const Sample& sample);
+            };
+
+            std::vector<Level> levels;
+            // the samples of the last level, which move up when levels are
+            // added above them
+            std::vector<Sample> top;
+            size_t samples {0};
+
+            int sandwich(const Sample& sample, int level) const;
+    };
+
+    class Monitor
+    {
+        public:
+            Monitor() {}
+            // writes the final estimates
+            ~Monitor();
+
+            Monitor(const Monitor&) = delete;
+            Monitor& operator=(const Monitor&) = delete;
+
+            // write `filename` every `interval` seconds
+            void start(double interval, const char* filename="kima_status.txt");
+
+            // the number of planets of the next saved sample (in the order
+            // of sample_info.txt)
+            void add_sample(int Np);
+
+        private:
+            std::string filename;
+            double interval {0.};
+            bool started {false};
+
+            std::thread thread;
+            std::mutex mutex;
+            std::condition_variable stop;
+            bool done {false};
+            // the number of planets of the samples not in `estimator` yet
+            std::vector<int> Np;
+
+            // where to continue in sample_info.txt, and the samples read
+            // that wait for their level or their number of planets
+            long long info_offset {0};
+            std::vector< std::vector<double> > pending;
+            Estimator estimator;
+
+            void run();
+            void update();
+    };
+
+    // the monitor of the run, fed by RVmodel::print
+    Monitor& monitor();
+}
+
+#endif
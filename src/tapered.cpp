@@ -0,0 +1,98 @@
+#include "tapered.h"
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+namespace tapered
+{
+
+void Solver::set_times(const double* t, size_t N)
+{
+    order.resize(N);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [t](size_t i, size_t j){ return t[i] < t[j]; });
+
+    this->t.resize(N);
+    for (size_t n=0; n<N; n++)
+        this->t[n] = t[order[n]];
+}
+
+
+bool Solver::factor(double eta1, double eta2, double eta3, double eta4,
+                    double cutoff, const double* diag)
+{
+    size_t N = order.size();
+
+    // the envelope: row i starts at the first point within the cutoff
+    first.resize(N);
+    start.resize(N + 1);
+    size_t j0 = 0;
+    start[0] = 0;
+    for (size_t i=0; i<N; i++)
+    {
+        while (t[i] - t[j0] >= cutoff)
+            j0++;
+        first[i] = j0;
+        start[i+1] = start[i] + (i - j0 + 1);
+    }
+    values.resize(start[N]);
+
+    // the covariance matrix, in place of L
+    double amp = eta1*eta1;
+    for (size_t i=0; i<N; i++)
+    {
+        std::ptrdiff_t row = base(i);
+        for (size_t j=first[i]; j<i; j++)
+        {
+            double dt = t[i] - t[j];
+            double s = std::sin(M_PI*dt/eta3)/eta4;
+            values[row + j] = amp * std::exp(-0.5*dt*dt/(eta2*eta2) - 2.0*s*s)
+                         * wendland(dt/cutoff);
+        }
+        values[row + i] = amp + diag[order[i]];
+    }
+
+    // row-oriented Cholesky in the envelope:
+    // L_ij = (C_ij - sum_k L_ik L_jk) / L_jj, for k in both envelopes, k < j
+    log_det = 0.;
+    for (size_t i=0; i<N; i++)
+    {
+        std::ptrdiff_t Li = base(i);
+        for (size_t j=first[i]; j<i; j++)
+        {
+            std::ptrdiff_t Lj = base(j);
+            size_t k0 = std::max(first[i], first[j]);
+            double sum = values[Li + j];
+            for (size_t k=k0; k<j; k++)
+                sum -= values[Li + k]*values[Lj + k];
+            values[Li + j] = sum / values[Lj + j];
+        }
+
+        double d = values[Li + i];
+        for (size_t k=first[i]; k<i; k++)
+            d -= values[Li + k]*values[Li + k];
+        if (!(d > 0.))
+            return false;
+        values[Li + i] = std::sqrt(d);
+        log_det += std::log(d);
+    }
+
+    return true;
+}
+
+
+void Solver::whiten(const double* y, double* z) const
+{
+    size_t N = order.size();
+    for (size_t i=0; i<N; i++)
+    {
+        std::ptrdiff_t Li = base(i);
+        double sum = y[order[i]];
+        for (size_t k=first[i]; k<i; k++)
+            sum -= values[Li + k]*z[k];
+        z[i] = sum / values[Li + i];
+    }
+}
+
+}
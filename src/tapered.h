@@ -0,0 +1,74 @@
+#ifndef DNest4_tapered
+#define DNest4_tapered
+
+#include <vector>
+#include <cstddef>
+
+/*
+    The quasi-periodic kernel of RVmodel tapered to compact support,
+        eta1^2 exp(-0.5 tau^2/eta2^2 - 2 sin^2(pi tau/eta3)/eta4^2) psi(tau/cutoff)
+    with the Wendland function psi(r) = (1 - r)^4 (1 + 4r) for r < 1 and 0
+    otherwise (Furrer, Genton & Nychka 2006). The product of the two kernels
+    is still positive definite, and only pairs of points closer than the
+    cutoff are correlated.
+
+    With the points in time order (the fill-reducing ordering, computed once
+    per dataset), each row of the covariance matrix is non-zero only from
+    the first point within the cutoff to the diagonal, and the Cholesky
+    factor has the same envelope (no fill-in). Both are stored row by row in
+    that envelope, so that memory and time scale with the number of
+    correlated pairs instead of N^2 (and N^3).
+*/
+namespace tapered
+{
+    // the Wendland taper, psi(r)
+    inline double wendland(double r)
+    {
+        if (r >= 1.) return 0.;
+        double s = 1. - r;
+        return s*s*s*s * (1. + 4.*r);
+    }
+
+    // Cholesky factorization C = L L^T of the covariance matrix, in envelope
+    // storage and in time order
+    class Solver
+    {
+        public:
+            Solver() {}
+
+            // set the times of the observations, in any order
+            void set_times(const double* t, size_t N);
+            size_t size() const { return order.size(); }
+
+            // build and factorize the covariance matrix, with the tapered
+            // kernel and the diagonal `diag` (in the order of the times given
+            // to set_times). Returns false if it is not positive definite
+            bool factor(double eta1, double eta2, double eta3, double eta4,
+                        double cutoff, const double* diag);
+
+            // log of the determinant of C
+            double log_determinant() const { return log_det; }
+
+            // z = L^-1 y, so that y^T C^-1 y = z^T z. The elements of z are
+            // in time order
+            void whiten(const double* y, double* z) const;
+
+            // number of elements stored in the envelope of L
+            size_t nonzeros() const { return values.size(); }
+
+        private:
+            // values[base(i) + j] is L_ij, for first[i] <= j <= i. The base
+            // itself is negative when row i starts past column start[i]
+            std::ptrdiff_t base(size_t i) const
+            { return std::ptrdiff_t(start[i]) - std::ptrdiff_t(first[i]); }
+
+            std::vector<size_t> order;  // argsort of the times
+            std::vector<double> t;      // sorted times
+            std::vector<size_t> first;  // first column in the envelope of each row
+            std::vector<size_t> start;  // where each row starts in values
+            std::vector<double> values; // the rows of L, from first[i] to i
+            double log_det {0.};
+    };
+}
+
+#endif
@@ -51,6 +51,28 @@ def test_keplerian():
     npt.assert_allclose(keplerian(times2, 1., 1., 0., 0., 0., 0.), 1.)
 
 
+def test_keplerian_batch():
+    from pykima.keplerian import keplerian, keplerian_batch
+
+    t = np.linspace(100., 200., 50)
+    # (P, K, phi, ecc, w); the last planet is not in the first sample
+    pars = np.array([[[10., 5., 1., 0.3, 2.], [33., 2., 4., 0., 0.], [0.] * 5],
+                     [[15., 3., 0., 0.7, 1.], [2., 1., 3., 0.1, 5.],
+                      [7., 4., 2., 0.5, 0.]]])
+    rv = keplerian_batch(t, pars, 100.)
+    assert rv.shape == (2, 50)
+
+    for s in range(2):
+        expected = np.zeros_like(t)
+        for P, K, phi, ecc, w in pars[s]:
+            if P != 0.:
+                t0 = 100. - P * phi / (2 * np.pi)
+                expected += keplerian(t, P, K, ecc, w, t0, 0.)
+        npt.assert_allclose(rv[s], expected, atol=1e-8)
+
+    assert keplerian_batch(t, np.zeros((3, 0, 5)), 100.).shape == (3, 50)
+
+
 ## pykima.utils
 
 
@@ -92,10 +114,59 @@ def test_planet_semimajor_axis():
     pass
 
 
+def test_read_appended(tmpdir):
+    from pykima.utils import read_appended
+
+    f1, f2 = str(tmpdir.join('a.rv')), str(tmpdir.join('b.rv'))
+    np.savetxt(f1, [[5., 1., 0.5], [6., 2., 0.6]], header='t y e')
+    np.savetxt(f2, [[7., -1e-3, 1e-3]])
+    setup = {'append': '%s,%s,' % (f1, f2), 'append_units': 'ms,kms,',
+             'append_skip': '1,0,', 'append_instrument': '1,3,'}
+
+    data, obs = read_appended(setup)
+    npt.assert_allclose(data, [[5., 1., 0.5], [6., 2., 0.6], [7., -1., 1.]])
+    npt.assert_array_equal(obs, [1, 1, 3])
+
+    # setup files written before Data::append
+    data, obs = read_appended({})
+    assert data.shape == (0, 3) and obs.size == 0
+
+
 def test_KimaResults():
     pass
 
 
+## pykima.binary
+
+
+def test_binary_roundtrip(tmpdir):
+    from pykima.binary import write_binary, read_binary, is_binary
+
+    f1, f2 = str(tmpdir.join('a.rv')), str(tmpdir.join('b.rv'))
+    np.savetxt(f1, [[3., 1., 0.5], [1., 2., 0.6]], header='t y e\n---')
+    np.savetxt(f2, [[2., -1., 0.7]], delimiter=',', header='t y e\n---')
+    out = str(tmpdir.join('data.rvb'))
+
+    write_binary(out, [f1, f2], units='kms', skip=2)
+    assert is_binary(out)
+    assert not is_binary(f1)
+
+    data, obs, info = read_binary(out)
+    # sorted in time, with one instrument per file
+    npt.assert_array_equal(data[:, 0], [1., 2., 3.])
+    npt.assert_array_equal(data[:, 1], [2., -1., 1.])
+    npt.assert_array_equal(obs, [1, 2, 1])
+    assert info['units'] == 'kms' and info['skip'] == 2 and info['multi']
+    assert info['names'] == ['a', 'b']
+
+    # a corrupted column is detected
+    with open(out, 'r+b') as f:
+        f.seek(-1, 2)
+        f.write(b'\x01')
+    with pytest.raises(ValueError, match='checksum'):
+        read_binary(out)
+
+
 ## pykima.dnest4
 
 
@@ -107,6 +178,80 @@ def test_logsumexp():
     npt.assert_allclose(logsumexp(a), s_logsumexp(a))
 
 
+def test_sandwiching_levels():
+    from pykima.classic import sandwiching_levels
+
+    levels = np.array([[0., -1e300, 0.], [-1., 1., 0.2], [-2., 2., 0.1],
+                       [-3., 2., 0.5], [-4., 4., 0.3]])
+    sample_info = np.array([[0, 0.5, 0.9], [0, 1.5, 0.1], [1, 2., 0.3],
+                            [1, 2., 0.5], [2, 5., 0.], [4, 3., 0.2]])
+
+    # the loop of the original DNest4 postprocess
+    sandwich = sample_info[:,0].astype(int)
+    for i in range(sample_info.shape[0]):
+        while sandwich[i] < levels.shape[0] - 1 and \
+              tuple(sample_info[i, 1:]) + (i,) > tuple(levels[sandwich[i] + 1, 1:]):
+            sandwich[i] += 1
+
+    npt.assert_array_equal(sandwiching_levels(levels, sample_info), sandwich)
+    npt.assert_array_equal(sandwich, [0, 1, 2, 3, 4, 4])
+
+
+def test_my_loadtxt(tmpdir):
+    from pykima.loading import my_loadtxt, loadtxt_rows, TextLoader
+
+    f = str(tmpdir.join('sample.txt'))
+    with open(f, 'w') as fout:
+        fout.write('# a b c\n1 2 3\n4 5 6\n7 8 9\n10 11\n12 13 14\n')
+
+    # stops at the ragged row
+    npt.assert_array_equal(my_loadtxt(f), [[1, 2, 3], [4, 5, 6], [7, 8, 9]])
+    npt.assert_array_equal(my_loadtxt(f, usecols=[2]), [[3], [6], [9]])
+    rows = loadtxt_rows(f, {0, 2, 10})
+    assert sorted(k for k in rows if k != 'ncol') == [0, 2]
+    assert rows['ncol'] == 3
+    npt.assert_array_equal(rows[2], [7, 8, 9])
+
+    # rows added to the file, in small chunks
+    with open(f, 'w') as fout:
+        fout.write('# a b c\n1 2 3\n4 5')
+    loader = TextLoader(f, chunk_size=4)
+    assert loader.update(last_line=False).shape == (1, 3)
+    with open(f, 'a') as fout:
+        fout.write(' 6\n7 8 9\n')
+    npt.assert_array_equal(loader.update(), [[1, 2, 3], [4, 5, 6], [7, 8, 9]])
+
+    # no rows of numbers, or not a number
+    with open(f, 'w') as fout:
+        fout.write('# a b c\n')
+    with pytest.raises(IndexError):
+        my_loadtxt(f)
+    with open(f, 'w') as fout:
+        fout.write('1 2 3\n4 x 6\n')
+    with pytest.raises(ValueError):
+        my_loadtxt(f)
+
+
+def test_load_binary_samples(tmpdir):
+    import struct
+    from pykima.loading import load_binary_samples
+
+    names = b'extra_sigma   ndim   maxNp   Np   P   K   phi   ecc   w   staleness   vsys'
+    header = struct.pack('<8sIIII', b'KIMASMP\x00', 1, 192, 3, len(names) + 1)
+    header += b'\x00' * (64 - len(header)) + names
+    header += b'\x00' * (192 - len(header))
+    records = np.arange(7.).tobytes()  # the last record is incomplete
+
+    f = str(tmpdir.join('sample.bin'))
+    with open(f, 'wb') as fout:
+        fout.write(header + records)
+
+    sample, columns = load_binary_samples(f)
+    assert isinstance(sample, np.memmap)
+    assert columns[0] == 'extra_sigma' and columns[-1] == 'vsys'
+    npt.assert_array_equal(sample, [[0., 1., 2.], [3., 4., 5.]])
+
+
 ## pykima.showresults
 
 